@@ -0,0 +1,120 @@
+#ifndef BINARY_FORMAT_HPP
+#define BINARY_FORMAT_HPP
+
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+#include "Ray.hpp"
+
+namespace RayBox {
+
+	/**
+	 * @brief      Fixed width binary records for ray input and results.
+	 * 				All integers are little endian.
+	 *
+	 * 				Ray record (8 bytes):
+	 * 					byte 0      port, 0 = column (C), 1 = row (R)
+	 * 					byte 1      direction, 0 = '+', 1 = '-'
+	 * 					bytes 2-3   reserved, 0
+	 * 					bytes 4-7   uint32 index, 1 based as in text format
+	 *
+	 * 				Result record (16 bytes):
+	 * 					bytes 0-3   int32 row, 1 based as in text format
+	 * 					bytes 4-7   int32 column
+	 * 					byte 8      outcome, see RayResult::Outcome
+	 * 					bytes 9-11  reserved, 0
+	 * 					bytes 12-15 uint32 hop count
+	 */
+	class BinaryFormat {
+	public:
+		static const size_t RayRecordSize			= 8;
+		static const size_t ResultRecordSize		= 16;
+
+		/**
+		 * @brief      { Simple binary file reader with binding call on every record read.
+		 * 				Errors are not caught here: output of a binary run may be binary, so the
+		 * 				caller reports them away from it and stops. }
+		 *
+		 * @param[in]  fileName    The file name
+		 * @param[in]  recordSize  The record size
+		 * @param[in]  readerFunc  The reader function
+		 */
+		static void fileReader(const std::string& fileName, const size_t recordSize,
+			std::function<void(const char*)> readerFunc) throw(std::logic_error) {
+			std::ifstream file(fileName.c_str(), std::ios::in | std::ios::binary);
+			if (!file.is_open())
+				throw std::logic_error("Unable to open " + fileName);
+
+			/// Reading records in chunks, it avoids a stream call per record
+			std::vector<char> buffer(recordSize * 4096);
+			while (file) {
+				file.read(buffer.data(), buffer.size());
+				size_t count = static_cast<size_t>(file.gcount());
+				if (count % recordSize != 0)
+					throw std::logic_error("Truncated record in " + fileName);
+				for (size_t offset = 0; offset < count; offset += recordSize)
+					readerFunc(buffer.data() + offset);
+			}
+		}
+
+		static void encodeRay(const RayInput& input, char* record) {
+			record[0] = input._port == 'C' ? 0 : 1;
+			record[1] = input._sign == '+' ? 0 : 1;
+			record[2] = 0;
+			record[3] = 0;
+			putUint32(record + 4, static_cast<uint32_t>(input._index));
+		}
+
+		static RayInput decodeRay(const char* record) throw(std::logic_error) {
+			if (record[0] != 0 && record[0] != 1)
+				throw std::logic_error("Invalid port in ray record");
+			if (record[1] != 0 && record[1] != 1)
+				throw std::logic_error("Invalid direction in ray record");
+
+			RayInput input;
+			input._port = record[0] == 0 ? 'C' : 'R';
+			input._sign = record[1] == 0 ? '+' : '-';
+			input._index = static_cast<int>(getUint32(record + 4));
+			return input;
+		}
+
+		static void encodeResult(const RayResult& result, char* record) {
+			putUint32(record, static_cast<uint32_t>(result._row));
+			putUint32(record + 4, static_cast<uint32_t>(result._column));
+			record[8] = static_cast<char>(result._outcome);
+			record[9] = 0;
+			record[10] = 0;
+			record[11] = 0;
+			putUint32(record + 12, static_cast<uint32_t>(result._hops));
+		}
+
+		static RayResult decodeResult(const char* record) {
+			RayResult result;
+			result._row = static_cast<int32_t>(getUint32(record));
+			result._column = static_cast<int32_t>(getUint32(record + 4));
+			result._outcome = static_cast<RayResult::Outcome>(static_cast<uint8_t>(record[8]));
+			result._hops = static_cast<int>(getUint32(record + 12));
+			return result;
+		}
+
+	private:
+		static inline void putUint32(char* out, uint32_t value) {
+			out[0] = static_cast<char>(value & 0xff);
+			out[1] = static_cast<char>((value >> 8) & 0xff);
+			out[2] = static_cast<char>((value >> 16) & 0xff);
+			out[3] = static_cast<char>((value >> 24) & 0xff);
+		}
+
+		static inline uint32_t getUint32(const char* in) {
+			const unsigned char* bytes = reinterpret_cast<const unsigned char*>(in);
+			return static_cast<uint32_t>(bytes[0]) | (static_cast<uint32_t>(bytes[1]) << 8) |
+				(static_cast<uint32_t>(bytes[2]) << 16) | (static_cast<uint32_t>(bytes[3]) << 24);
+		}
+	};
+
+}
+
+#endif //BINARY_FORMAT_HPP
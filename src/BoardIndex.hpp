@@ -0,0 +1,283 @@
+#ifndef BOARD_INDEX_HPP
+#define BOARD_INDEX_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "Ray.hpp"
+#include "RayBox.hpp"
+
+namespace RayBox {
+
+	/**
+	 * @brief      Read only snapshot of a RayBox in flat arrays, for tracing engines which keep
+	 * 				many rays in flight.
+	 * 				Every row and column is a line: lines 0 .. size-1 are rows, lines size .. 2*size-1
+	 * 				are columns. Mirrors of a line are stored in _positions / _kinds between
+	 * 				_offsets[line] and _offsets[line + 1], sorted by position in the line.
+	 *
+	 * 				Snapshot does not follow mirror evaporation, so it gives same results as
+	 * 				Raybox only when board is static ( see isStatic ).
+	 */
+	class BoardIndex {
+	public:
+
+		/**
+		 * @brief      Enum for what a mirror does to ray, derived from mirror deflection angle.
+		 */
+		enum class Kind : uint8_t {
+			Neg90										= 0,
+			Pos90,
+			Reverse,
+			Absorb
+		};
+
+		/**
+		 * @brief      { Direction change and next co-ordinates step of a deflection }
+		 */
+		struct Turn {
+			int8_t										_direction;
+			int8_t										_row;
+			int8_t										_column;
+		};
+
+		/**
+		 * @brief      { Builds snapshot of mirrors currently present in RayBox }
+		 *
+		 * @param      rayBox  The ray box
+		 */
+		BoardIndex(Raybox& rayBox) : _size(rayBox.getSize()), _static(true),
+			_offsets(std::vector<int32_t>(2 * rayBox.getSize() + 1)) {
+			/// Counting mirrors per line, then prefix sum gives line offsets
+			for (int row = 0; row < _size; row++) {
+				for (auto itr : rayBox.getRow(row)) {
+					_offsets[itr->getRowIndex() + 1]++;
+					_offsets[_size + itr->getColumnIndex() + 1]++;
+				}
+			}
+			for (int line = 0; line < 2 * _size; line++)
+				_offsets[line + 1] += _offsets[line];
+
+			/// Kinds are padded by 3 entries, so vector code may read 4 bytes at any entry
+			_positions.resize(_offsets[2 * _size]);
+			_kinds.resize(_offsets[2 * _size] + 3, Kind::Absorb);
+
+			/// Mirrors are stored row by row, so both rows and columns come out sorted
+			std::vector<int32_t> fill(_offsets.begin(), _offsets.end() - 1);
+			for (int row = 0; row < _size; row++) {
+				for (auto itr : rayBox.getRow(row)) {
+					Kind kind = toKind(itr->getdeflectionAngle());
+					if (kind == Kind::Absorb && itr->getStrength() > 0)
+						_static = false;
+
+					int32_t entry = fill[itr->getRowIndex()]++;
+					_positions[entry] = itr->getColumnIndex();
+					_kinds[entry] = kind;
+
+					entry = fill[_size + itr->getColumnIndex()]++;
+					_positions[entry] = itr->getRowIndex();
+					_kinds[entry] = kind;
+				}
+			}
+		}
+
+		/**
+		 * @brief      { true when no mirror can evaporate, so results do not depend on ray order }
+		 */
+		inline bool isStatic() const {
+			return _static;
+		}
+
+		inline int getSize() const {
+			return _size;
+		}
+
+		/**
+		 * @brief      { Line travelled by the ray in its current direction }
+		 *
+		 * @param[in]  ray   The ray
+		 */
+		inline int line(const Ray& ray) const {
+			return isHorizontal(ray._direction) ? ray._row : _size + ray._column;
+		}
+
+		/**
+		 * @brief      { Address of line offsets, for prefetching }
+		 *
+		 * @param[in]  line  The line
+		 */
+		inline const int32_t* lineOffsets(int line) const {
+			return _offsets.data() + line;
+		}
+
+		inline const int32_t* getPositions() const {
+			return _positions.data();
+		}
+
+		inline const Kind* getKinds() const {
+			return _kinds.data();
+		}
+
+		/**
+		 * @brief      { Passes the ray to next mirror on its line and applies the mirror. }
+		 *
+		 * @param      ray     The ray
+		 * @param      result  The result, filled when ray has finished
+		 * @param      cycle   Cycle detection state of the ray
+		 *
+		 * @return     { true when ray has left the box, was absorbed or is stopped in a cycle }
+		 */
+		inline bool hop(Ray& ray, RayResult& result, RayCycle& cycle) const {
+			const int32_t* offsets = lineOffsets(line(ray));
+			const int32_t* begin = _positions.data() + offsets[0];
+			const int32_t* end = _positions.data() + offsets[1];
+			const int32_t* found = nullptr;
+
+			switch (ray._direction)
+			{
+			case Ray::Direction::LeftToRight:
+			case Ray::Direction::TopToBottom: {
+				const int32_t* itr = std::lower_bound(begin, end, position(ray));
+				if (itr != end)
+					found = itr;
+			}
+			break;
+			default: {
+				const int32_t* itr = std::upper_bound(begin, end, position(ray));
+				if (itr != begin)
+					found = itr - 1;
+			}
+			break;
+			}
+
+			if (found == nullptr) {
+				exit(ray, result);
+				return true;
+			}
+
+			if (isHorizontal(ray._direction))
+				ray._column = *found;
+			else
+				ray._row = *found;
+			if (apply(_kinds[found - _positions.data()], ray, result))
+				return true;
+			if (cycle.repeats(ray)) {
+				stop(ray, result);
+				return true;
+			}
+			return false;
+		}
+
+		/**
+		 * @brief      { Applies mirror to ray which has reached it }
+		 *
+		 * @param[in]  kind    The mirror kind
+		 * @param      ray     The ray
+		 * @param      result  The result, filled when ray is absorbed
+		 *
+		 * @return     { true when ray was absorbed }
+		 */
+		static inline bool apply(Kind kind, Ray& ray, RayResult& result) {
+			if (kind == Kind::Absorb) {
+				result._row = ray._row + 1;
+				result._column = ray._column + 1;
+				result._outcome = RayResult::Outcome::Absorbed;
+				return true;
+			}
+			const Turn& next = turn(kind, ray._direction);
+			ray._direction = static_cast<Ray::Direction>(next._direction);
+			ray._row += next._row;
+			ray._column += next._column;
+			result._hops++;
+			return false;
+		}
+
+		/**
+		 * @brief      { Deflection table, same moves as Mirror::deflectRay }
+		 *
+		 * @param[in]  kind       The mirror kind, except Absorb
+		 * @param[in]  direction  The ray direction
+		 */
+		static inline const Turn& turn(Kind kind, Ray::Direction direction) {
+			static const Turn table[3][4] = {
+				/// LeftToRight, RightToLeft, BottomToTop, TopToBottom
+				{ { 2, -1, 0 }, { 2, -1, 0 }, { 0, 0, 1 }, { 0, 0, 1 } },
+				{ { 3, 1, 0 }, { 3, 1, 0 }, { 1, 0, -1 }, { 1, 0, -1 } },
+				{ { 1, 0, -1 }, { 0, 0, 1 }, { 3, -1, 0 }, { 2, 1, 0 } }
+			};
+			return table[static_cast<int>(kind)][static_cast<int>(direction)];
+		}
+
+		/**
+		 * @brief      { Fills result for ray leaving the box, same co-ordinates as Raybox }
+		 *
+		 * @param[in]  ray     The ray
+		 * @param      result  The result
+		 */
+		inline void exit(const Ray& ray, RayResult& result) const {
+			result._outcome = RayResult::Outcome::Exited;
+			switch (ray._direction)
+			{
+			case Ray::Direction::LeftToRight:
+				result._row = ray._row + 1;
+				result._column = _size;
+				break;
+			case Ray::Direction::RightToLeft:
+				result._row = ray._row + 1;
+				result._column = 0;
+				break;
+			case Ray::Direction::TopToBottom:
+				result._row = _size;
+				result._column = ray._column + 1;
+				break;
+			default:
+				result._row = 0;
+				result._column = ray._column + 1;
+				break;
+			}
+		}
+
+		/**
+		 * @brief      { Fills result for ray stopped in an endless cycle, see RayCycle }
+		 */
+		static inline void stop(const Ray& ray, RayResult& result) {
+			result._row = ray._row + 1;
+			result._column = ray._column + 1;
+			result._outcome = RayResult::Outcome::Unknown;
+		}
+
+		static inline Kind toKind(int angle) {
+			switch (angle)
+			{
+			case -90:
+				return Kind::Neg90;
+			case 90:
+				return Kind::Pos90;
+			case -180:
+			case 180:
+				return Kind::Reverse;
+			default:
+				return Kind::Absorb;
+			}
+		}
+
+		static inline bool isHorizontal(Ray::Direction direction) {
+			return direction == Ray::Direction::LeftToRight || direction == Ray::Direction::RightToLeft;
+		}
+
+		static inline int position(const Ray& ray) {
+			return isHorizontal(ray._direction) ? ray._column : ray._row;
+		}
+
+	private:
+		int													_size;
+		bool												_static;
+		std::vector<int32_t>								_offsets;
+		std::vector<int32_t>								_positions;
+		std::vector<Kind>									_kinds;
+	};
+
+}
+
+#endif //BOARD_INDEX_HPP
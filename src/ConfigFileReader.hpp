@@ -1,11 +1,14 @@
 #ifndef CONFIG_FILE_READER_HPP
 #define CONFIG_FILE_READER_HPP
 
+#include <cstdio>
 #include <fstream>
+#include <functional>
 #include <sstream>
 
 #include "common.hpp"
 #include "RayBox.hpp"
+#include "ResultWriter.hpp"
 
 namespace RayBox {
 
@@ -28,24 +31,47 @@ namespace RayBox {
 		 *
 		 * @param[in]  fileName    The file name
 		 * @param[in]  readerFunc  The reader function
+		 *
+		 * @return     { false when file can not be opened or a line is rejected, error is printed
+		 * 				and lines after it are not read }
 		 */
-		static void fileReader(const std::string& fileName, std::function<void(std::string&)> readerFunc) {
+		static bool fileReader(const std::string& fileName, std::function<void(std::string&)> readerFunc) {
 			try {
 				std::fstream configFile(fileName.c_str());
-				if (configFile.is_open()) {
-					std::string line;
-					while (std::getline(configFile, line)) {
-						if (line[0] == '#' || line.length() == 0)
-							continue;
-						readerFunc(line);
-					}
+				if (!configFile.is_open())
+					throw std::logic_error("Unable to open");
+				std::string line;
+				while (std::getline(configFile, line)) {
+					if (line[0] == '#' || line.length() == 0)
+						continue;
+					readerFunc(line);
 				}
 				configFile.close();
 			}
 			catch (std::exception& ex) {
-				std::cout << "error while reading " << fileName.c_str() << ": " 
+				std::cerr << "error while reading " << fileName.c_str() << ": " 
 					<< ex.what() << std::endl;
+				return false;
 			}
+			return true;
+		}
+
+		/**
+		 * @brief      { Reads side of the board, the first line of configuration file }
+		 *
+		 * @param[in]  fileName  The config file name
+		 *
+		 * @return     { Side of the board, 0 when file can not be read }
+		 */
+		static int readBoardSize(const std::string& fileName) {
+			std::fstream configFile(fileName.c_str());
+			std::string line;
+			while (std::getline(configFile, line)) {
+				if (line[0] == '#' || line.length() == 0)
+					continue;
+				return std::stoi(line);
+			}
+			return 0;
 		}
 
 		/**
@@ -55,15 +81,22 @@ namespace RayBox {
 		 * 						line format: 1st line: Side of Sqaure (RayBox)
 		 * 									 2nd line onwards: RowNumber ColNumber Strength (Mirror Details) 
 		 * @param[ref] rayBox  Instance of raybox
+		 * @param[in]  shard   The band of rows to load, when board is split in shards
+		 * @param[in]  shards  Number of shards; mirrors outside the band and its adjacent rows are skipped
 		 */
-		static void parseConfigFile(const std::string& line, std::shared_ptr<RayBox::Raybox>& rayBox) throw(std::logic_error) {
+		static void parseConfigFile(const std::string& line, std::shared_ptr<RayBox::Raybox>& rayBox,
+			const int shard, const int shards) throw(std::logic_error) {
 			static int lineNo = 0;
+			static int rowBegin = 0;
+			static int rowEnd = 0;
 
 			if (0 == lineNo) {
 				int capacity = std::stoi(line);
 				if (capacity < 1)
 					throw std::logic_error("invalid input column size");
-				rayBox = std::make_shared<Raybox>(capacity);
+				rowBegin = Raybox::bandBegin(capacity, shard, shards);
+				rowEnd = Raybox::bandBegin(capacity, shard + 1, shards);
+				rayBox = std::make_shared<Raybox>(capacity, rowBegin, rowEnd);
 			}
 
 			if (lineNo > 0) {
@@ -76,6 +109,12 @@ namespace RayBox {
 				if (r < 0 || r > rayBox->getSize())
 					std::logic_error("Invalid row in ray Input file");
 
+				/// Mirrors in adjacent rows still place reference mirrors in the band
+				if (r < rowBegin - 1 || r > rowEnd) {
+					lineNo++;
+					return;
+				}
+
 				int c = std::stoi(column) - 1;
 				if (c < 0 || c > rayBox->getSize())
 					std::logic_error("Invalid column in ray Input file");
@@ -97,57 +136,87 @@ namespace RayBox {
 		}
 
 		/**
-		 * @brief      { Input data file reading function }
+		 * @brief      { Parses one line of ray input file }
 		 *
-		 * @param[in]  line    Data line mentioning direction of ray and co-ordinates of entering
-		 * 						line format: C/R Number +/-
-		 * @param[ref] rayBox  Instance of raybox
-		 * 
-		 * 
+		 * @param[in]  line    Data line, format: C/R Number +/-
+		 * @param[out] input   The parsed ray
+		 *
+		 * @return     { false when line does not describe a ray }
 		 */
-		static void parseRayInputFile(const std::string& line, std::shared_ptr<RayBox::Raybox>& rayBox) throw(std::logic_error) {
-			static int lineNo = 0;
+		static bool parseRayLine(const std::string& line, RayInput& input) throw(std::logic_error) {
+			if (line[0] != 'C' && line[0] != 'R')
+				return false;
+
+			input._port = line[0];
+			input._sign = line[line.length() - 1];
+			if (input._sign != '+' && input._sign != '-')
+				throw std::logic_error(input._port == 'C' ? "Invalid input direction " : "Invalid Input");
+			input._index = atoi(line.substr(1, line.length() - 2).c_str());
+			return true;
+		}
 
-			switch (line[0])
-			{
-			case 'C': {
-				Ray ray;
+		/**
+		 * @brief      { Formats ray in the input file notation, e.g. C7+ }
+		 *
+		 * @param[in]  input  The ray
+		 */
+		static std::string formatRay(const RayInput& input) {
+			return input._port + std::to_string(input._index) + input._sign;
+		}
+
+		/**
+		 * @brief      { Creates ray entering the box at the given port }
+		 *
+		 * @param[in]  input  The ray as given in input
+		 * @param[in]  size   Side of the RayBox
+		 */
+		static Ray toRay(const RayInput& input, int size) throw(std::logic_error) {
+			Ray ray;
+			if (input._port == 'C') {
 				ray._row = 0;
-				if (line[line.length() - 1] == '-') {
+				ray._direction = Ray::Direction::TopToBottom;
+				if (input._sign == '-') {
 					ray._direction = Ray::Direction::BottomToTop;
-					ray._row = rayBox->getSize() - 1;
+					ray._row = size - 1;
 				}
-				else if (line[line.length() - 1] == '+')
-					ray._direction = Ray::Direction::TopToBottom;
-				else
-					throw std::logic_error("Invalid input direction ");
-				ray._column = atoi(line.substr(1, line.length() - 2).c_str()) - 1;
-				if (ray._column > rayBox->getSize())
+				ray._column = input._index - 1;
+				if (ray._column < 0 || ray._column >= size)
 					throw std::logic_error("Invalid Input");
-				std::cout << line.c_str() << " -> ";
-				rayBox->PassTheRay(ray);
 			}
-			break;
-			case 'R': {
-				Ray ray;
+			else {
 				ray._column = 0;
-				if (line[line.length() - 1] == '-') {
+				ray._direction = Ray::Direction::LeftToRight;
+				if (input._sign == '-') {
 					ray._direction = Ray::Direction::RightToLeft;
-					ray._column = rayBox->getSize() - 1;
+					ray._column = size - 1;
 				}
-				else if (line[line.length() - 1] == '+')
-					ray._direction = Ray::Direction::LeftToRight;
-				else
-					throw std::logic_error("Invalid Input");
-				ray._row = atoi(line.substr(1, line.length() - 2).c_str()) - 1;
-				if (ray._row > rayBox->getSize())
+				ray._row = input._index - 1;
+				if (ray._row < 0 || ray._row >= size)
 					throw std::logic_error("Invalid Input");
-				std::cout << line.c_str() << " -> ";
-				rayBox->PassTheRay(ray);
 			}
-			break;
-			}
-			lineNo++;
+			return ray;
+		}
+
+		/**
+		 * @brief      { Parses one line of text result, e.g. {8,7} or C7+ -> {8,7} }
+		 *
+		 * @param[in]  line    The result line
+		 * @param[out] result  The result. Text format has no hops, and no outcome but the
+		 * 					   Unknown mark ( see ResultWriter ), other results are read as Exited
+		 *
+		 * @return     { false when line does not hold a result }
+		 */
+		static bool parseResultLine(const std::string& line, RayResult& result) {
+			size_t pos = line.rfind('{');
+			if (pos == std::string::npos)
+				return false;
+			if (sscanf(line.c_str() + pos, "{%d,%d}", &result._row, &result._column) != 2)
+				return false;
+			result._outcome = RayResult::Outcome::Exited;
+			if (line.find(ResultWriter::UnknownMark, pos) != std::string::npos)
+				result._outcome = RayResult::Outcome::Unknown;
+			result._hops = 0;
+			return true;
 		}
 	};
 }
@@ -0,0 +1,159 @@
+#ifndef EPOCH_MANAGER_HPP
+#define EPOCH_MANAGER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+namespace RayBox {
+
+	/**
+	 * @brief      Class for epoch based reclamation of data shared between readers and a writer.
+	 * 				Writer replaces shared data by publishing a new version, and retires the old
+	 * 				version with the epoch it was unlinked in. A reader announces the epoch it
+	 * 				started in while it reads. A retired version is freed once every active reader
+	 * 				has started after it was unlinked, since those readers can only see the new one.
+	 *
+	 * 				Readers never wait: entering and leaving is a store to the reader's own slot.
+	 * 				Retire and reclaim are called by one writer at a time.
+	 */
+	class EpochManager {
+	public:
+		static const int MaxReaders							= 64;
+
+		/**
+		 * @brief      { Reader slot, claimed by a reader thread for its lifetime }
+		 */
+		class Reader {
+		public:
+			Reader(EpochManager& epochs) throw(std::logic_error) : _epochs(epochs), _slot(epochs.claim()) {
+			}
+
+			~Reader() {
+				_epochs.release(_slot);
+			}
+
+			Reader(const Reader&) = delete;
+			Reader& operator=(const Reader&) = delete;
+
+			/**
+			 * @brief      { Starts a read, data read until leave is not freed }
+			 */
+			inline void enter() {
+				_epochs._slots[_slot]._epoch.store(_epochs._epoch.load());
+			}
+
+			inline void leave() {
+				_epochs._slots[_slot]._epoch.store(Idle, std::memory_order_release);
+			}
+
+		private:
+			EpochManager&									_epochs;
+			int												_slot;
+		};
+
+		/**
+		 * @brief      { Read section for the scope of the guard }
+		 */
+		class Guard {
+		public:
+			Guard(Reader& reader) : _reader(reader) {
+				_reader.enter();
+			}
+
+			~Guard() {
+				_reader.leave();
+			}
+
+		private:
+			Reader&											_reader;
+		};
+
+		EpochManager() : _epoch(1) {
+			for (auto& slot : _slots) {
+				slot._epoch.store(Idle);
+				slot._claimed.store(false);
+			}
+		}
+
+		~EpochManager() {
+			for (auto& retired : _retired)
+				retired._free();
+		}
+
+		EpochManager(const EpochManager&) = delete;
+		EpochManager& operator=(const EpochManager&) = delete;
+
+		/**
+		 * @brief      { Retires an object already unlinked from shared data }
+		 *
+		 * @param      object  The object, deleted when no reader can hold it
+		 */
+		template <typename T>
+		void retire(T* object) {
+			Retired retired;
+			retired._epoch = _epoch.fetch_add(1);
+			retired._free = [object]() { delete object; };
+			_retired.push_back(retired);
+		}
+
+		/**
+		 * @brief      { Frees retired objects which no active reader can hold }
+		 */
+		void reclaim() {
+			uint64_t oldest = UINT64_MAX;
+			for (auto& slot : _slots) {
+				uint64_t epoch = slot._epoch.load();
+				if (epoch != Idle && epoch < oldest)
+					oldest = epoch;
+			}
+
+			size_t kept = 0;
+			for (size_t i = 0; i < _retired.size(); i++) {
+				if (_retired[i]._epoch < oldest)
+					_retired[i]._free();
+				else
+					_retired[kept++] = _retired[i];
+			}
+			_retired.resize(kept);
+		}
+
+	private:
+		static const uint64_t Idle							= 0;
+
+		/// Slots are cache line aligned, so readers do not write to each other's lines
+		struct alignas(64) Slot {
+			std::atomic<uint64_t>						_epoch;
+			std::atomic<bool>							_claimed;
+		};
+
+		struct Retired {
+			uint64_t									_epoch;
+			std::function<void()>						_free;
+		};
+
+		int claim() throw(std::logic_error) {
+			for (int slot = 0; slot < MaxReaders; slot++) {
+				bool claimed = false;
+				if (_slots[slot]._claimed.compare_exchange_strong(claimed, true))
+					return slot;
+			}
+			throw std::logic_error("Too many readers");
+		}
+
+		void release(int slot) {
+			_slots[slot]._epoch.store(Idle);
+			_slots[slot]._claimed.store(false, std::memory_order_release);
+		}
+
+	private:
+		std::atomic<uint64_t>								_epoch;
+		Slot												_slots[MaxReaders];
+		std::vector<Retired>								_retired;
+	};
+
+}
+
+#endif //EPOCH_MANAGER_HPP
@@ -0,0 +1,117 @@
+#ifndef INTERLEAVED_TRACER_HPP
+#define INTERLEAVED_TRACER_HPP
+
+#include <vector>
+
+#include "BoardIndex.hpp"
+#include "common.hpp"
+#include "Ray.hpp"
+
+namespace RayBox {
+
+	/**
+	 * @brief      Class for tracing a group of rays in flight at once.
+	 * 				Every hop of a ray is two dependent memory reads, line offsets and then
+	 * 				mirrors of the line. On boards larger than cache each of them is a miss, so
+	 * 				instead of waiting the tracer prefetches the next read of one ray and moves
+	 * 				on to the next ray of the group. By the time it comes back the data is in
+	 * 				cache, and the misses of the whole group overlap.
+	 *
+	 * 				Results are same as Raybox::PassTheRay for a static board ( see BoardIndex ).
+	 */
+	class InterleavedTracer {
+	public:
+		InterleavedTracer(const BoardIndex& index, const int groupSize = 32)
+			: _index(index), _groupSize(groupSize < 1 ? 1 : groupSize) {
+		}
+
+		/**
+		 * @brief      { Traces all rays, results are stored in input order }
+		 *
+		 * @param[in]  rays     The rays
+		 * @param[out] results  The results
+		 */
+		void trace(const std::vector<Ray>& rays, std::vector<RayResult>& results) {
+			results.resize(rays.size());
+			std::vector<Slot> slots(_groupSize);
+
+			size_t next = 0;
+			int active = 0;
+			for (auto& slot : slots) {
+				if (next < rays.size()) {
+					start(slot, next, rays[next]);
+					next++;
+					active++;
+				}
+			}
+
+			/// Round robin over the group, each visit moves one ray by one stage
+			while (active > 0) {
+				for (auto& slot : slots) {
+					if (slot._index < 0)
+						continue;
+
+					if (slot._stage == Stage::Line) {
+						/// Line offsets were prefetched on the previous visit
+						const int32_t* offsets = _index.lineOffsets(_index.line(slot._ray));
+						PREFETCH(_index.getPositions() + offsets[0]);
+						PREFETCH(_index.getPositions() + ((offsets[0] + offsets[1]) >> 1));
+						PREFETCH(_index.getKinds() + offsets[0]);
+						slot._stage = Stage::Mirror;
+						continue;
+					}
+
+					if (!_index.hop(slot._ray, slot._result, slot._cycle)) {
+						PREFETCH(_index.lineOffsets(_index.line(slot._ray)));
+						slot._stage = Stage::Line;
+						continue;
+					}
+
+					results[slot._index] = slot._result;
+					if (next < rays.size()) {
+						start(slot, next, rays[next]);
+						next++;
+					}
+					else {
+						slot._index = -1;
+						active--;
+					}
+				}
+			}
+		}
+
+	private:
+
+		/**
+		 * @brief      Enum for memory read a ray is waiting for.
+		 */
+		enum class Stage {
+			Line										= 0,
+			Mirror
+		};
+
+		struct Slot {
+			long										_index				= -1;
+			Ray											_ray;
+			RayResult									_result;
+			RayCycle									_cycle;
+			Stage										_stage				= Stage::Line;
+		};
+
+		inline void start(Slot& slot, size_t index, const Ray& ray) {
+			slot._index = static_cast<long>(index);
+			slot._ray = ray;
+			slot._result._hops = 0;
+			slot._cycle = RayCycle();
+			slot._stage = Stage::Line;
+			PREFETCH(_index.lineOffsets(_index.line(ray)));
+		}
+
+	private:
+		const BoardIndex&									_index;
+		int													_groupSize;
+	};
+
+}
+
+#endif //INTERLEAVED_TRACER_HPP
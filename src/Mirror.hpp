@@ -1,6 +1,7 @@
 #ifndef MIRROR_HPP
 #define MIRROR_HPP
 
+#include <atomic>
 #include <vector>
 #include <memory>
 #include "Ray.hpp"
@@ -21,9 +22,13 @@ namespace RayBox {
 			undefined									= -1,
 			Hit											= 0,
 			Deflected,
-			Evaporated
+			Evaporated,
+			Passed
 		};
 
+		/// Strength of a mirror which has evaporated and waits to be removed from the board
+		static const int EvaporatedStrength					= -1;
+
 		Mirror() = default;
 		~Mirror() = default;
 
@@ -43,18 +48,24 @@ namespace RayBox {
 		Mirror(const Mirror& mirror) {
 			this->_columnIndex							= mirror._columnIndex;
 			this->_rowIndex								= mirror._rowIndex;
-			this->_strength								= mirror._strength;
+			this->_strength.store(mirror._strength.load());
 			this->_deflectionAngle						= mirror._deflectionAngle;
 		}
 
 		/**
 		 * @brief      { Provides function for deflecting ray to correct path, on mirror collision }
 		 *
-		 * @param      ray   The ray
+		 * @param      ray    The ray
+		 * @param[in]  decay  When false mirror strength is left as it is, an absorbing mirror
+		 * 					  only reports Hit. Used by readers which must not change the board.
+		 *
+		 * 				Strength is used up atomically, so rays on many threads may hit same mirror:
+		 * 				exactly one of them gets Evaporated. A ray reaching a mirror which evaporated
+		 * 				but is not removed yet goes on past it ( Passed ).
 		 *
 		 * @return     { Enum for providing result of deflection due to mirror. }
 		 */
-		DeflectionResult deflectRay(Ray& ray) {
+		DeflectionResult deflectRay(Ray& ray, const bool decay = true) {
 			switch (_deflectionAngle)
 			{
 			case -90:
@@ -67,14 +78,19 @@ namespace RayBox {
 			case 180:
 				deflectRayBy180(ray);
 				return DeflectionResult::Deflected;
-			case 0:
-				if (_strength > 0) {
-					decreaseStrength();
-					if (_strength == 0)
-						return DeflectionResult::Evaporated;
+			case 0: {
+				int strength = _strength.load();
+				while (decay && strength > 0) {
+					if (decreaseStrength(strength))
+						return strength == 1 ? DeflectionResult::Evaporated : DeflectionResult::Hit;
+				}
+				if (strength < 0) {
+					passRay(ray);
+					return DeflectionResult::Passed;
 				}
 				return DeflectionResult::Hit;
 			}
+			}
 			return DeflectionResult::undefined;
 		}
 
@@ -180,17 +196,41 @@ namespace RayBox {
 			}
 		}
 
-		
-		void decreaseStrength() {
-			if (_strength > 0) {
-				--_strength;
+		void passRay(Ray& ray) {
+			switch (ray._direction) {
+			case Ray::Direction::LeftToRight:
+				ray._column							+= 1;
+				break;
+			case Ray::Direction::RightToLeft:
+				ray._column							-= 1;
+				break;
+			case Ray::Direction::TopToBottom:
+				ray._row							+= 1;
+				break;
+			case Ray::Direction::BottomToTop:
+				ray._row							-= 1;
+				break;
+			default:
+				std::cout << "Invalid direction in PassTheRay" << std::endl;
+				return ;
 			}
 		}
 
+		/**
+		 * @brief      { Uses up one strength unless another ray changed it first }
+		 *
+		 * @param      strength  Strength seen by the ray, updated when another ray changed it
+		 *
+		 * @return     { true when this ray used it up, last unit leaves the mirror evaporated }
+		 */
+		bool decreaseStrength(int& strength) {
+			return _strength.compare_exchange_weak(strength, strength == 1 ? EvaporatedStrength : strength - 1);
+		}
+
 	private:
 		int											_columnIndex;
 		int											_rowIndex;
-		int											_strength;
+		std::atomic<int>							_strength;
 		int											_deflectionAngle;
 	};
 
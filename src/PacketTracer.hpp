@@ -0,0 +1,273 @@
+#ifndef PACKET_TRACER_HPP
+#define PACKET_TRACER_HPP
+
+#include <cstdint>
+#include <vector>
+
+#include "BoardIndex.hpp"
+#include "Ray.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	#define PACKET_TRACER_AVX2
+	#include <immintrin.h>
+#endif
+
+namespace RayBox {
+
+	/**
+	 * @brief      Class for tracing packets of rays in lockstep with AVX2.
+	 * 				State of 8 rays ( row, column, direction, hops and cycle detection, see
+	 * 				RayCycle ) is kept one ray per vector lane. Every step looks up next mirror of all lanes with gathers and a vector
+	 * 				binary search, and deflects them through a table instead of branching per
+	 * 				ray. Lanes whose ray has finished are masked out and refilled from input.
+	 *
+	 * 				Falls back to scalar tracing on CPUs without AVX2. Results are same as
+	 * 				Raybox::PassTheRay for a static board ( see BoardIndex ).
+	 */
+	class PacketTracer {
+	public:
+		static const int Lanes								= 8;
+
+		PacketTracer(const BoardIndex& index) : _index(index) {
+			/// Deflection table packed per entry: direction | (row step + 1) << 8 | (column step + 1) << 16
+			for (int kind = 0; kind < 4; kind++) {
+				for (int direction = 0; direction < 4; direction++) {
+					int32_t packed = 0;
+					if (kind != static_cast<int>(BoardIndex::Kind::Absorb)) {
+						const BoardIndex::Turn& next = BoardIndex::turn(static_cast<BoardIndex::Kind>(kind),
+							static_cast<Ray::Direction>(direction));
+						packed = next._direction | ((next._row + 1) << 8) | ((next._column + 1) << 16);
+					}
+					_turns[(kind * 4) + direction] = packed;
+				}
+			}
+		}
+
+		/**
+		 * @brief      { Traces all rays, results are stored in input order }
+		 *
+		 * @param[in]  rays     The rays
+		 * @param[out] results  The results
+		 */
+		void trace(const std::vector<Ray>& rays, std::vector<RayResult>& results) {
+			results.resize(rays.size());
+#ifdef PACKET_TRACER_AVX2
+			if (__builtin_cpu_supports("avx2")) {
+				traceAvx2(rays, results);
+				return;
+			}
+#endif
+			traceScalar(rays, results);
+		}
+
+		/**
+		 * @brief      { Scalar fallback, one ray at a time }
+		 *
+		 * @param[in]  rays     The rays
+		 * @param[out] results  The results
+		 */
+		void traceScalar(const std::vector<Ray>& rays, std::vector<RayResult>& results) {
+			results.resize(rays.size());
+			for (size_t i = 0; i < rays.size(); i++) {
+				Ray ray = rays[i];
+				RayCycle cycle;
+				results[i]._hops = 0;
+				while (!_index.hop(ray, results[i], cycle));
+			}
+		}
+
+	private:
+
+		/**
+		 * @brief      { State of the rays in flight, one ray per lane. Saved state, power and
+		 * 				length are RayCycle of the lane }
+		 */
+		struct Packet {
+			alignas(32) int32_t							_row[Lanes];
+			alignas(32) int32_t							_column[Lanes];
+			alignas(32) int32_t							_direction[Lanes];
+			alignas(32) int32_t							_hops[Lanes];
+			alignas(32) int32_t							_active[Lanes];
+			alignas(32) int32_t							_savedRow[Lanes];
+			alignas(32) int32_t							_savedColumn[Lanes];
+			alignas(32) int32_t							_savedDirection[Lanes];
+			alignas(32) int32_t							_power[Lanes];
+			alignas(32) int32_t							_length[Lanes];
+			long										_index[Lanes];
+		};
+
+#ifdef PACKET_TRACER_AVX2
+		__attribute__((target("avx2")))
+		static inline __m256i load(const int32_t* lanes) {
+			return _mm256_load_si256(reinterpret_cast<const __m256i*>(lanes));
+		}
+
+		__attribute__((target("avx2")))
+		static inline void store(int32_t* lanes, __m256i value) {
+			_mm256_store_si256(reinterpret_cast<__m256i*>(lanes), value);
+		}
+
+		__attribute__((target("avx2")))
+		void traceAvx2(const std::vector<Ray>& rays, std::vector<RayResult>& results) {
+			Packet packet;
+
+			size_t next = 0;
+			int count = 0;
+			for (int lane = 0; lane < Lanes; lane++) {
+				if (refill(lane, next, rays, packet))
+					count++;
+			}
+
+			const int32_t* offsets = _index.lineOffsets(0);
+			const int32_t* positions = _index.getPositions();
+			const int* kinds = reinterpret_cast<const int*>(_index.getKinds());
+			const __m256i zero = _mm256_setzero_si256();
+			const __m256i one = _mm256_set1_epi32(1);
+			const __m256i byte = _mm256_set1_epi32(0xff);
+			const __m256i size = _mm256_set1_epi32(_index.getSize());
+
+			while (count > 0) {
+				__m256i vrow = load(packet._row);
+				__m256i vcolumn = load(packet._column);
+				__m256i vdirection = load(packet._direction);
+				__m256i vhops = load(packet._hops);
+				__m256i vactive = load(packet._active);
+
+				/// Line of every lane and its mirrors range
+				__m256i horizontal = _mm256_cmpgt_epi32(_mm256_set1_epi32(2), vdirection);
+				__m256i line = _mm256_blendv_epi8(_mm256_add_epi32(size, vcolumn), vrow, horizontal);
+				__m256i begin = _mm256_mask_i32gather_epi32(zero, offsets, line, vactive, 4);
+				__m256i end = _mm256_mask_i32gather_epi32(zero, offsets + 1, line, vactive, 4);
+
+				/// Forward lanes look for first position >= ray position, backward lanes for
+				/// last position <= ray position, i.e. one before first position >= ray position + 1
+				__m256i position = _mm256_blendv_epi8(vrow, vcolumn, horizontal);
+				__m256i forward = _mm256_or_si256(_mm256_cmpeq_epi32(vdirection, zero),
+					_mm256_cmpeq_epi32(vdirection, _mm256_set1_epi32(3)));
+				__m256i key = _mm256_add_epi32(position, _mm256_andnot_si256(forward, one));
+
+				/// Binary search in lockstep, until every lane has narrowed its range
+				__m256i low = begin;
+				__m256i length = _mm256_sub_epi32(end, begin);
+				for (;;) {
+					__m256i live = _mm256_cmpgt_epi32(length, zero);
+					if (_mm256_testz_si256(live, live))
+						break;
+					__m256i half = _mm256_srli_epi32(length, 1);
+					__m256i middle = _mm256_add_epi32(low, half);
+					__m256i value = _mm256_mask_i32gather_epi32(zero, positions, middle, live, 4);
+					__m256i less = _mm256_and_si256(_mm256_cmpgt_epi32(key, value), live);
+					low = _mm256_blendv_epi8(low, _mm256_add_epi32(middle, one), less);
+					length = _mm256_blendv_epi8(half, _mm256_sub_epi32(_mm256_sub_epi32(length, half), one), less);
+				}
+
+				__m256i entry = _mm256_blendv_epi8(_mm256_sub_epi32(low, one), low, forward);
+				__m256i found = _mm256_and_si256(vactive, _mm256_blendv_epi8(_mm256_cmpgt_epi32(low, begin),
+					_mm256_cmpgt_epi32(end, low), forward));
+				__m256i mirror = _mm256_mask_i32gather_epi32(zero, positions, entry, found, 4);
+				__m256i kind = _mm256_and_si256(_mm256_mask_i32gather_epi32(zero, kinds, entry, found, 1), byte);
+
+				/// Moving lanes to their mirrors, then deflecting all but absorbed ones
+				vcolumn = _mm256_blendv_epi8(vcolumn, mirror, _mm256_and_si256(found, horizontal));
+				vrow = _mm256_blendv_epi8(vrow, mirror, _mm256_andnot_si256(horizontal, found));
+				__m256i deflect = _mm256_and_si256(found,
+					_mm256_cmpgt_epi32(_mm256_set1_epi32(static_cast<int>(BoardIndex::Kind::Absorb)), kind));
+				__m256i turn = _mm256_mask_i32gather_epi32(zero, _turns,
+					_mm256_add_epi32(_mm256_slli_epi32(kind, 2), vdirection), deflect, 4);
+				vdirection = _mm256_blendv_epi8(vdirection, _mm256_and_si256(turn, byte), deflect);
+				vrow = _mm256_add_epi32(vrow, _mm256_and_si256(deflect,
+					_mm256_sub_epi32(_mm256_and_si256(_mm256_srli_epi32(turn, 8), byte), one)));
+				vcolumn = _mm256_add_epi32(vcolumn, _mm256_and_si256(deflect,
+					_mm256_sub_epi32(_mm256_and_si256(_mm256_srli_epi32(turn, 16), byte), one)));
+				vhops = _mm256_sub_epi32(vhops, deflect);
+
+				/// Deflected lanes back in their saved state are in a cycle, others count the
+				/// deflection and save their state after power deflections, as RayCycle::repeats
+				__m256i vsavedRow = load(packet._savedRow);
+				__m256i vsavedColumn = load(packet._savedColumn);
+				__m256i vsavedDirection = load(packet._savedDirection);
+				__m256i vpower = load(packet._power);
+				__m256i cycling = _mm256_and_si256(deflect, _mm256_and_si256(_mm256_cmpeq_epi32(vrow, vsavedRow),
+					_mm256_and_si256(_mm256_cmpeq_epi32(vcolumn, vsavedColumn), _mm256_cmpeq_epi32(vdirection, vsavedDirection))));
+				__m256i counted = _mm256_andnot_si256(cycling, deflect);
+				__m256i vlength = _mm256_sub_epi32(load(packet._length), counted);
+				__m256i save = _mm256_and_si256(counted, _mm256_cmpeq_epi32(vlength, vpower));
+				store(packet._savedRow, _mm256_blendv_epi8(vsavedRow, vrow, save));
+				store(packet._savedColumn, _mm256_blendv_epi8(vsavedColumn, vcolumn, save));
+				store(packet._savedDirection, _mm256_blendv_epi8(vsavedDirection, vdirection, save));
+				store(packet._power, _mm256_blendv_epi8(vpower, _mm256_add_epi32(vpower, vpower), save));
+				store(packet._length, _mm256_andnot_si256(save, vlength));
+
+				store(packet._row, vrow);
+				store(packet._column, vcolumn);
+				store(packet._direction, vdirection);
+				store(packet._hops, vhops);
+
+				/// Finished lanes: result is written and lane takes next ray from input. Lanes
+				/// in a cycle finish too
+				int finished = _mm256_movemask_ps(_mm256_castsi256_ps(
+					_mm256_or_si256(_mm256_andnot_si256(deflect, vactive), cycling)));
+				int absorbed = _mm256_movemask_ps(_mm256_castsi256_ps(found));
+				int cycled = _mm256_movemask_ps(_mm256_castsi256_ps(cycling));
+				while (finished != 0) {
+					int lane = __builtin_ctz(finished);
+					finished &= finished - 1;
+
+					RayResult& result = results[packet._index[lane]];
+					result._hops = packet._hops[lane];
+					Ray ray;
+					ray._row = packet._row[lane];
+					ray._column = packet._column[lane];
+					ray._direction = static_cast<Ray::Direction>(packet._direction[lane]);
+					if (cycled & (1 << lane))
+						BoardIndex::stop(ray, result);
+					else if (absorbed & (1 << lane))
+						BoardIndex::apply(BoardIndex::Kind::Absorb, ray, result);
+					else
+						_index.exit(ray, result);
+
+					if (!refill(lane, next, rays, packet))
+						count--;
+				}
+			}
+		}
+#endif
+
+		/**
+		 * @brief      { Loads next input ray into a lane, or marks lane inactive }
+		 *
+		 * @return     { true when lane got a ray }
+		 */
+		inline bool refill(int lane, size_t& next, const std::vector<Ray>& rays, Packet& packet) {
+			RayCycle cycle;
+			packet._hops[lane] = 0;
+			packet._savedRow[lane] = cycle._row;
+			packet._savedColumn[lane] = cycle._column;
+			packet._savedDirection[lane] = cycle._direction;
+			packet._power[lane] = cycle._power;
+			packet._length[lane] = cycle._length;
+			if (next == rays.size()) {
+				packet._row[lane] = 0;
+				packet._column[lane] = 0;
+				packet._direction[lane] = 0;
+				packet._active[lane] = 0;
+				packet._index[lane] = -1;
+				return false;
+			}
+			packet._row[lane] = rays[next]._row;
+			packet._column[lane] = rays[next]._column;
+			packet._direction[lane] = static_cast<int32_t>(rays[next]._direction);
+			packet._active[lane] = -1;
+			packet._index[lane] = static_cast<long>(next);
+			next++;
+			return true;
+		}
+
+	private:
+		const BoardIndex&									_index;
+		alignas(32) int32_t									_turns[16];
+	};
+
+}
+
+#endif //PACKET_TRACER_HPP
@@ -20,6 +20,70 @@ namespace RayBox {
 		Direction								_direction;
 	};
 
+	/**
+	 * @brief      { Ray as given in the input: entry port, 1 based index and sign, e.g. C7+ }
+	 */
+	struct RayInput {
+		char									_port;
+		int										_index;
+		char									_sign;
+	};
+
+	/**
+	 * @brief      { Result of passing a ray: 1 based co-ordinates where it left the box or
+	 * 				was absorbed, what happened there and number of deflections on the way }
+	 */
+	struct RayResult {
+		enum class Outcome {
+			Exited								= 0,
+			Absorbed,
+			Evaporated,
+			HandedOff,
+			Unknown								= 255
+		};
+
+		int										_row;
+		int										_column;
+		Outcome									_outcome;
+		int										_hops;
+	};
+
+	/**
+	 * @brief      { Brent's cycle detection over states ( cell and direction ) a ray is in after
+	 * 				its deflections. A ray back in a state it was in before goes round forever.
+	 * 				A state is saved after every power of two deflections and later states are
+	 * 				compared with it, so a cycle is found within two rounds of it, at constant memory }
+	 */
+	struct RayCycle {
+		/// Saved state, none while _direction is -1
+		int										_row				= 0;
+		int										_column				= 0;
+		int										_direction			= -1;
+		/// Deflections before next save, and deflections since last save
+		int										_power				= 1;
+		int										_length				= 0;
+
+		/**
+		 * @brief      { Checks state of the ray after a deflection }
+		 *
+		 * @param[in]  ray   The ray
+		 *
+		 * @return     { true when ray is in a cycle }
+		 */
+		inline bool repeats(const Ray& ray) {
+			if (ray._row == _row && ray._column == _column && static_cast<int>(ray._direction) == _direction)
+				return true;
+			if (++_length == _power) {
+				_row = ray._row;
+				_column = ray._column;
+				_direction = static_cast<int>(ray._direction);
+				_power *= 2;
+				_length = 0;
+			}
+			return false;
+		}
+	};
+
 }
 
 #endif //RAY_HPP
\ No newline at end of file
@@ -2,29 +2,112 @@
 //
 
 #include <functional>
+#include <thread>
 
+#include "BinaryFormat.hpp"
+#include "BoardIndex.hpp"
 #include "ConfigFileReader.hpp"
 #include "common.hpp"
+#include "InterleavedTracer.hpp"
+#include "PacketTracer.hpp"
 #include "RayBox.hpp"
+#include "RelaxedTracer.hpp"
+#include "ResultWriter.hpp"
+#include "ShardedRaybox.hpp"
 using namespace RayBox;
 
+/// Number of rays read before a batch engine traces them
+static const size_t BatchSize = 65536;
 
 
 int main(int argc, char** argv)
 {
-	if (argc != 3) {
-		std::cout << "Usage: <RayBox> <ConfigFileName> <RayInputFile>" << std::endl;
+	if (argc < 3) {
+		std::cout << "Usage: <RayBox> <ConfigFileName> <RayInputFile> [--lazy]"
+			" [--ray-format=text|binary] [--result-format=text|binary] [--output=<ResultFile>]"
+			" [--engine=serial|interleaved|packet|relaxed] [--group=<RaysInFlight>] [--shards=<Processes>]"
+			" [--shard-addresses=<Address>,...] [--threads=<Threads>]" << std::endl;
+		std::cout << "       relaxed engine traces on many threads, rays reaching a finite life mirror"
+			" may get other results than with serial engine, and differ between runs" << std::endl;
+		std::cout << "       shard addresses are RayShard servers in band order, a Unix socket path"
+			" or host:port each" << std::endl;
+		return 1;
+	}
+
+	/// Optional flags following the input files
+	bool lazy = false;
+	bool binaryRays = false;
+	ResultWriter::Format resultFormat = ResultWriter::Format::Text;
+	std::string output;
+	std::string engine("serial");
+	int group = 32;
+	int shards = 0;
+	std::vector<std::string> addresses;
+	int threads = static_cast<int>(std::thread::hardware_concurrency());
+	for (int i = 3; i < argc; i++) {
+		std::string option(argv[i]);
+		if (option == "--lazy")
+			lazy = true;
+		else if (option == "--ray-format=text" || option == "--ray-format=binary")
+			binaryRays = (option == "--ray-format=binary");
+		else if (option == "--result-format=text")
+			resultFormat = ResultWriter::Format::Text;
+		else if (option == "--result-format=binary")
+			resultFormat = ResultWriter::Format::Binary;
+		else if (option.compare(0, 9, "--output=") == 0)
+			output = option.substr(9);
+		else if (option == "--engine=serial" || option == "--engine=interleaved" || option == "--engine=packet"
+			|| option == "--engine=relaxed")
+			engine = option.substr(9);
+		else if (option.compare(0, 8, "--group=") == 0)
+			group = atoi(option.substr(8).c_str());
+		else if (option.compare(0, 9, "--shards=") == 0)
+			shards = atoi(option.substr(9).c_str());
+		else if (option.compare(0, 18, "--shard-addresses=") == 0) {
+			std::istringstream list(option.substr(18));
+			std::string address;
+			while (std::getline(list, address, ','))
+				addresses.push_back(address);
+		}
+		else if (option.compare(0, 10, "--threads=") == 0)
+			threads = atoi(option.substr(10).c_str());
+		else {
+			std::cout << "Unknown option: " << option.c_str() << std::endl;
+			return 1;
+		}
+	}
+
+	if (shards > 0 && !addresses.empty()) {
+		std::cout << "Shards are either started here or given as addresses" << std::endl;
+		return 1;
+	}
+	if (!addresses.empty() && lazy) {
+		std::cout << "Lazy references of shard servers are chosen when starting RayShard" << std::endl;
+		return 1;
+	}
+	if ((shards > 0 || !addresses.empty()) && engine != "serial") {
+		std::cout << "Sharded board runs serial engine in every shard" << std::endl;
+		return 1;
+	}
+	if (engine == "relaxed" && lazy) {
+		std::cout << "Relaxed engine needs eager references" << std::endl;
 		return 1;
 	}
 
 	std::shared_ptr<Raybox> rayBox;
+	std::unique_ptr<ShardedRaybox> shardedBox;
 	std::string config(argv[1]);
 
-	///Reading config file
+	///Reading config file, or starting shard processes which read their band of it
 	try
 	{
-		ConfigReader::fileReader(config,
-			std::bind(ConfigReader::parseConfigFile, std::placeholders::_1, std::ref(rayBox)));
+		if (shards > 0)
+			shardedBox.reset(new ShardedRaybox(config, shards, lazy));
+		else if (!addresses.empty())
+			shardedBox.reset(new ShardedRaybox(config, addresses));
+		else if (!ConfigReader::fileReader(config,
+			std::bind(ConfigReader::parseConfigFile, std::placeholders::_1, std::ref(rayBox), 0, 1)))
+			return 1;
 	}
 	catch (const std::exception& ex)
 	{
@@ -32,25 +115,108 @@ int main(int argc, char** argv)
 		return 1;
 	}
 	
-	if (rayBox.get() == nullptr)
+	if (rayBox.get() == nullptr && shardedBox.get() == nullptr)
 	{
 		std::cout << "Raybox initialization failed" << std::endl;
 		return 1;
 	}
+	const int size = rayBox.get() != nullptr ? rayBox->getSize() : shardedBox->getSize();
 
-	/// Covering book keeping information, which helps in reducing processing time
-	rayBox->initReferences();
+	/// Covering book keeping information, which helps in reducing processing time.
+	/// In lazy mode it is built per row/column when a ray first travels it.
+	if (rayBox.get() != nullptr)
+		rayBox->initReferences(lazy);
 
-	//// Reading data file with ray direction and co-ordinates on each line
+	/// Results go to standard output unless a result file is given
+	std::ofstream outputFile;
+	if (!output.empty()) {
+		outputFile.open(output.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!outputFile.is_open()) {
+			std::cout << "Unable to open result file " << output.c_str() << std::endl;
+			return 1;
+		}
+	}
+	ResultWriter writer(output.empty() ? std::cout : outputFile, resultFormat);
+
+	/// Engines other than serial trace rays in batches, against a snapshot of the board
+	std::unique_ptr<BoardIndex> index;
+	std::unique_ptr<RelaxedTracer> relaxed;
+	std::function<void(const std::vector<Ray>&, std::vector<RayResult>&)> traceBatch;
+	if (shardedBox.get() != nullptr)
+		traceBatch = [&](const std::vector<Ray>& rays, std::vector<RayResult>& results) {
+			shardedBox->trace(rays, results);
+		};
+	else if (engine == "relaxed") {
+		try {
+			relaxed.reset(new RelaxedTracer(*rayBox, threads));
+		}
+		catch (const std::exception& ex) {
+			std::cerr << "Error RelaxedTracer : " << ex.what() << std::endl;
+			return 1;
+		}
+		traceBatch = [&](const std::vector<Ray>& rays, std::vector<RayResult>& results) {
+			relaxed->trace(rays, results);
+		};
+	}
+	else if (engine != "serial") {
+		index.reset(new BoardIndex(*rayBox));
+		if (!index->isStatic())
+			std::cerr << "Board has mirrors with finite life, using serial engine" << std::endl;
+		else if (engine == "interleaved")
+			traceBatch = [&](const std::vector<Ray>& rays, std::vector<RayResult>& results) {
+				InterleavedTracer(*index, group).trace(rays, results);
+			};
+		else
+			traceBatch = [&](const std::vector<Ray>& rays, std::vector<RayResult>& results) {
+				PacketTracer(*index).trace(rays, results);
+			};
+	}
+
+	std::vector<Ray> rays;
+	std::vector<std::string> labels;
+	std::vector<RayResult> results;
+	auto flush = [&]() {
+		traceBatch(rays, results);
+		for (size_t i = 0; i < rays.size(); i++)
+			writer.write(labels[i], results[i]);
+		rays.clear();
+		labels.clear();
+	};
+	auto submit = [&](const std::string& label, Ray& ray) {
+		if (!traceBatch) {
+			writer.write(label, rayBox->PassTheRay(ray));
+			return;
+		}
+		rays.push_back(ray);
+		labels.push_back(label);
+		if (rays.size() == BatchSize)
+			flush();
+	};
+
+	//// Reading data file with ray direction and co-ordinates on each line ( or record )
 	std::string rayInputFile(argv[2]);
 	try {
 		TIMER_START(Total);
-		ConfigReader::fileReader(rayInputFile,
-			std::bind(ConfigReader::parseRayInputFile, std::placeholders::_1, std::ref(rayBox)));
+		if (binaryRays)
+			BinaryFormat::fileReader(rayInputFile, BinaryFormat::RayRecordSize, [&](const char* record) {
+				RayInput input = BinaryFormat::decodeRay(record);
+				Ray ray = ConfigReader::toRay(input, size);
+				submit(resultFormat == ResultWriter::Format::Text ? ConfigReader::formatRay(input) : std::string(), ray);
+			});
+		else if (!ConfigReader::fileReader(rayInputFile, [&](std::string& line) {
+				RayInput input;
+				if (!ConfigReader::parseRayLine(line, input))
+					return;
+				Ray ray = ConfigReader::toRay(input, size);
+				submit(line, ray);
+			}))
+			return 1;
+		if (!rays.empty())
+			flush();
 		TIMER_STOP(Total)
 	}
 	catch (std::exception& ex) {
-		std::cout << "Error parseConfigFile : " << ex.what() << std::endl;
+		std::cerr << "Error parseConfigFile : " << ex.what() << std::endl;
 		return 1;
 	}
 
@@ -1,7 +1,11 @@
 #ifndef REYBOX_HPP
 #define REYBOX_HPP
 
+#include <algorithm>
+#include <atomic>
 #include <iostream>
+#include <mutex>
+#include "EpochManager.hpp"
 #include "Ray.hpp"
 #include "Mirror.hpp"
 
@@ -11,12 +15,44 @@ namespace RayBox {
 	 * @brief      Class for raybox.
 	 * 				This class covers majority of processing ray using list of Mirrors.
 	 * 				Specification of Game is given in pdf file name : reybox 3.pdf
+	 *
+	 * 				A Raybox may hold only a band of rows of the board ( a shard ). Co-ordinates stay
+	 * 				board wide; a ray leaving the band vertically is returned as HandedOff, positioned in
+	 * 				the edge row of the neighbouring band it continues in.
+	 *
+	 * 				Mirrors are stored sparse, in a list per row sorted by column and a list per
+	 * 				column sorted by row, so memory follows the number of mirrors, not board size.
+	 * 				These lists are changed only by the writer; tracing reads published copies.
+	 *
+	 * 				Row and column lists are published together as one immutable board Version.
+	 * 				Board changes ( evaporation, AddMirror ) are made by one writer at a time under
+	 * 				a lock: the writer copies the version, replaces the changed lists, publishes
+	 * 				the copy with one pointer store and retires the old version whole to an
+	 * 				EpochManager. A trace reads the version published when it started for all of
+	 * 				its passes, so query threads ( QueryTheRay ) see every change either fully or
+	 * 				not at all; many threads may also trace changing the board with PassTheRayRelaxed.
 	 */		
 	class Raybox {
 
 	public:
-		Raybox(const int columns) : _maxColumns(columns), _mirrors(std::vector<std::shared_ptr<Mirror>>(columns*columns)),
-			_rowRefMirrorList(std::vector<MirrorList>(columns)), _colRefMirrorList(std::vector<MirrorList>(columns)) {
+		Raybox(const int columns) : Raybox(columns, 0, columns) {
+		}
+
+		/**
+		 * @brief      { Constructor for a band of rows of the board }
+		 *
+		 * @param[in]  columns   Side of the board
+		 * @param[in]  rowBegin  First row of the band
+		 * @param[in]  rowEnd    One past last row of the band
+		 */
+		Raybox(const int columns, const int rowBegin, const int rowEnd) : _maxColumns(columns),
+			_rowBegin(rowBegin), _rowEnd(rowEnd),
+			_rows(rowEnd - rowBegin), _columns(columns),
+			_version(new Version(rowEnd - rowBegin, columns)), _lazyReferences(false) {
+		}
+
+		~Raybox() {
+			delete _version.load();
 		}
 
 		/**
@@ -24,165 +60,524 @@ namespace RayBox {
 		 * 				Ray parameter contains current direction and co-ordinates of Ray. }
 		 *
 		 * @param      ray   The ray
+		 *
+		 * @return     { Where and how the ray finished, with number of deflections }
 		 */
-		void PassTheRay(Ray& ray) noexcept {
-
-			switch (ray._direction)
-			{
-			case Ray::Direction::LeftToRight:
-				return PassFromLeftToRight(ray);
-			case Ray::Direction::RightToLeft:
-				return PassFromRightToLeft(ray);
-			case Ray::Direction::TopToBottom:
-				return PassFromTopToBottom(ray);
-			case Ray::Direction::BottomToTop:
-				return PassFromBottomToTop(ray);
-			default:
-				std::cout << "Invalid direction in PassTheRay" << std::endl;
-				return ;
-			}
+		RayResult PassTheRay(Ray& ray) noexcept {
+			RayCycle cycle;
+			return PassTheRay(ray, cycle);
+		}
+
+		/**
+		 * @brief      { Passes the ray like PassTheRay, going on with cycle detection of a ray
+		 * 				handed off from another band, so a ray going round between bands is stopped
+		 * 				where a single Raybox stops it }
+		 *
+		 * @param      ray    The ray
+		 * @param      cycle  Cycle detection state of the ray, updated by the trace
+		 *
+		 * @return     { Where and how the ray finished, with number of deflections }
+		 */
+		RayResult PassTheRay(Ray& ray, RayCycle& cycle) noexcept {
+			std::lock_guard<std::mutex> lock(_writeLock);
+			return traceRay(ray, TraceMode::Write, cycle);
+		}
+
+		/**
+		 * @brief      { Passes the ray without changing the board, mirror strength is not used up.
+		 * 				Safe to call from many threads while another thread runs PassTheRay or
+		 * 				AddMirror: it never waits for them, and traces the whole ray against the
+		 * 				board version published when it started. Needs eager references. }
+		 *
+		 * @param      ray     The ray
+		 * @param      reader  Reader slot of the calling thread, see getEpochs
+		 *
+		 * @return     { Where and how the ray finished, with number of deflections }
+		 */
+		RayResult QueryTheRay(Ray& ray, EpochManager::Reader& reader) throw(std::logic_error) {
+			if (_lazyReferences)
+				throw std::logic_error("Query needs eager references");
+			EpochManager::Guard guard(reader);
+			RayCycle cycle;
+			return traceRay(ray, TraceMode::Query, cycle);
+		}
+
+		/**
+		 * @brief      { Passes the ray using up mirror strength like PassTheRay, but many threads may
+		 * 				call it at once. Threads trace lock free like QueryTheRay, and strength is used
+		 * 				up atomically; the one ray which uses up the last unit evaporates the mirror and
+		 * 				removes it from the board under the writer lock.
+		 *
+		 * 				Order of rays is not kept: which ray evaporates a mirror, and so results of rays
+		 * 				reaching it, depend on thread timing. Every mirror still evaporates exactly once,
+		 * 				after its whole strength is used up. Needs eager references. }
+		 *
+		 * @param      ray     The ray
+		 * @param      reader  Reader slot of the calling thread, see getEpochs
+		 *
+		 * @return     { Where and how the ray finished, with number of deflections }
+		 */
+		RayResult PassTheRayRelaxed(Ray& ray, EpochManager::Reader& reader) throw(std::logic_error) {
+			if (_lazyReferences)
+				throw std::logic_error("Relaxed tracing needs eager references");
+			EpochManager::Guard guard(reader);
+			RayCycle cycle;
+			return traceRay(ray, TraceMode::Relaxed, cycle);
 		}
 
 		/**
 		 * @brief      Adds a mirror to list of Mirrors. 
 		 * 				This function also adds reference mirror which are in adjacent diagonal sides of mirror.
+		 * 				Mirror can be added after references are built, changed rows and columns are
+		 * 				published in a new board version.
 		 *
 		 * @param[in]  mirror  The mirror
 		 */
 		void AddMirror(std::shared_ptr<Mirror> mirror) throw(std::logic_error) {
+			std::lock_guard<std::mutex> lock(_writeLock);
+			placeMirror(mirror);
 
-			/// Original Mirror with 0 deflection, absorbing ray 
-			std::shared_ptr<Mirror> ref = _mirrors[(mirror->getRowIndex() * _maxColumns) + mirror->getColumnIndex()];
-			if (ref.get() == nullptr) {
-				_mirrors[(mirror->getRowIndex() * _maxColumns) + mirror->getColumnIndex()] = mirror;
+			Version* next = nullptr;
+			for (int row = mirror->getRowIndex() - 1; row <= mirror->getRowIndex() + 1; row++) {
+				if (inBand(row))
+					updateRow(next, row);
 			}
-			else {
-				std::cout << "Mirror: Row: " << ref->getRowIndex() << " Column: " << ref->getColumnIndex() << std::endl;
-				throw std::logic_error("Duplicate Mirror");
+			for (int col = mirror->getColumnIndex() - 1; col <= mirror->getColumnIndex() + 1; col++) {
+				if (col >= 0 && col < _maxColumns)
+					updateColumn(next, col);
+			}
+			publish(next);
+			_epochs.reclaim();
+		}
+
+		/**
+		 * @brief      { Simple function to print the RayBox with Mirror location }
+		 *
+		 * @param      out   Ostream 
+		 */
+		void print(std::ostream& out) {
+			for (auto& row : _rows) {
+				for (auto itr : row)
+					out << itr->getRowIndex() << "," << itr->getColumnIndex() << "," 
+					<< itr->getStrength() << "," << static_cast<int>(itr->getdeflectionAngle())
+					<< std::endl;
+			}
+		}
+
+		/**
+		 * @brief      { Manages references to MirrorList, so that processing can be improved. }
+		 *
+		 * @param[in]  lazy  When true, no list is published here. Each row or column list is
+		 * 					 copied from mirror storage the first time a ray travels it, so setup
+		 * 					 cost follows the rows and columns actually touched.
+		 */
+		void initReferences(bool lazy = false) {
+			std::lock_guard<std::mutex> lock(_writeLock);
+			_lazyReferences = lazy;
+			if (lazy)
+				return;
+			publish(buildVersion());
+			_epochs.reclaim();
+		}
+
+		inline int getSize() {
+			return _maxColumns;
+		}
+
+		/**
+		 * @brief      { First row of a band, when board is split into equal bands of rows }
+		 *
+		 * @param[in]  columns  Side of the board
+		 * @param[in]  band     The band
+		 * @param[in]  bands    Number of bands
+		 */
+		static inline int bandBegin(const int columns, const int band, const int bands) {
+			return static_cast<int>((static_cast<long long>(columns) * band) / bands);
+		}
+
+		/**
+		 * @brief      { true when row is held by this box }
+		 *
+		 * @param[in]  rowIndex  The row index
+		 */
+		inline bool inBand(int rowIndex) {
+			return rowIndex >= _rowBegin && rowIndex < _rowEnd;
+		}
+
+		/**
+		 * @brief      { true when no mirror can evaporate, so ray results do not depend on ray order }
+		 */
+		bool isStatic() {
+			for (auto& row : _rows) {
+				for (auto itr : row) {
+					if (itr->getdeflectionAngle() == 0 && itr->getStrength() > 0)
+						return false;
+				}
+			}
+			return true;
+		}
+
+		/**
+		 * @brief      { Mirrors of a row in the band, sorted by column. Read by writer thread only,
+		 * 				tracing threads use published lists }
+		 *
+		 * @param[in]  rowIndex  The row index
+		 */
+		inline const MirrorList& getRow(int rowIndex) {
+			return _rows[rowIndex - _rowBegin];
+		}
+
+		/**
+		 * @brief      { Mirror of a cell in the band, nullptr when there is none. Read by writer
+		 * 				thread only, like getRow }
+		 *
+		 * @param[in]  rowIndex  The row index
+		 * @param[in]  colIndex  The col index
+		 */
+		std::shared_ptr<Mirror> getMirror(int rowIndex, int colIndex) {
+			MirrorList& row = _rows[rowIndex - _rowBegin];
+			auto itr = atColumn(row, colIndex);
+			if (itr == row.end() || (*itr)->getColumnIndex() != colIndex)
+				return nullptr;
+			return *itr;
+		}
+
+		/**
+		 * @brief      { Epochs of the board versions, every query thread claims a reader from it }
+		 */
+		inline EpochManager& getEpochs() {
+			return _epochs;
+		}
+
+	private:
+
+		/// Number of row or column lists in a chunk of a board version
+		static const int ChunkLines							= 64;
+
+		/**
+		 * @brief      { Lists of a chunk of rows or columns, nullptr while a list is not built.
+		 * 				Lists and chunks are shared by versions which did not change them }
+		 */
+		struct Chunk {
+			std::shared_ptr<const MirrorList>			_lines[ChunkLines];
+		};
+
+		/**
+		 * @brief      { Immutable version of the board lists. A new version copies only the chunk
+		 * 				pointers, and a chunk when one of its lists is replaced }
+		 */
+		struct Version {
+			Version(const int rows, const int columns)
+				: _rows((rows + ChunkLines - 1) / ChunkLines), _columns((columns + ChunkLines - 1) / ChunkLines) {
+				for (auto& chunk : _rows)
+					chunk = std::make_shared<Chunk>();
+				for (auto& chunk : _columns)
+					chunk = std::make_shared<Chunk>();
+			}
+
+			/// Row index is relative to band begin
+			inline const MirrorList* row(int index) const {
+				return _rows[index / ChunkLines]->_lines[index % ChunkLines].get();
+			}
+
+			inline const MirrorList* column(int index) const {
+				return _columns[index / ChunkLines]->_lines[index % ChunkLines].get();
+			}
+
+			/// Stores list in place: only in a version not published yet, or with no readers
+			inline void setRow(int index, const MirrorList* list) {
+				_rows[index / ChunkLines]->_lines[index % ChunkLines].reset(list);
+			}
+
+			inline void setColumn(int index, const MirrorList* list) {
+				_columns[index / ChunkLines]->_lines[index % ChunkLines].reset(list);
+			}
+
+			std::vector<std::shared_ptr<Chunk>>			_rows;
+			std::vector<std::shared_ptr<Chunk>>			_columns;
+		};
+
+		/**
+		 * @brief      Enum for how a trace may change the board: Write when caller holds the writer
+		 * 				lock, Query leaves board as it is, Relaxed uses up strength and takes the writer
+		 * 				lock only to remove an evaporated mirror.
+		 */
+		enum class TraceMode {
+			Write										= 0,
+			Query,
+			Relaxed
+		};
+		
+		/**
+		 * @brief      { Iterating over deflections, see PassTheRay }
+		 *
+		 * @param      ray     The ray
+		 * @param[in]  mode    How the trace may change the board
+		 * @param      cycle   Cycle detection state of the ray
+		 */
+		RayResult traceRay(Ray& ray, const TraceMode mode, RayCycle& cycle) noexcept {
+			RayResult result;
+			result._hops = 0;
+
+			/// Whole trace reads one version. A trace which changes the board stops right after
+			/// the change, so it never reads lists of a version it retired
+			Version& version = *_version.load();
+
+			/// Iterating over deflections, every pass ends at a mirror or at the border
+			for (;;) {
+				/// Mirrors are read through plain pointers, the traced version keeps them alive
+				Mirror* mirror;
+				switch (ray._direction)
+				{
+				case Ray::Direction::LeftToRight:
+					mirror = PassFromLeftToRight(version, ray, result);
+					break;
+				case Ray::Direction::RightToLeft:
+					mirror = PassFromRightToLeft(version, ray, result);
+					break;
+				case Ray::Direction::TopToBottom:
+					mirror = PassFromTopToBottom(version, ray, result);
+					break;
+				case Ray::Direction::BottomToTop:
+					mirror = PassFromBottomToTop(version, ray, result);
+					break;
+				default:
+					std::cout << "Invalid direction in PassTheRay" << std::endl;
+					result._row = ray._row + 1;
+					result._column = ray._column + 1;
+					result._outcome = RayResult::Outcome::Unknown;
+					return result;
+				}
+
+				if (mirror == nullptr || !deflectMirror(mirror, ray, result, mode))
+					return result;
+				/// Ray in an endless cycle is stopped as Unknown
+				if (cycle.repeats(ray)) {
+					result._row = ray._row + 1;
+					result._column = ray._column + 1;
+					result._outcome = RayResult::Outcome::Unknown;
+					return result;
+				}
+			}
+		}
+
+		/**
+		 * @brief      { Places mirror and its reference mirrors in the board cells }
+		 *
+		 * @param[in]  mirror  The mirror
+		 */
+		void placeMirror(std::shared_ptr<Mirror> mirror) throw(std::logic_error) {
+
+			/// Original Mirror with 0 deflection, absorbing ray 
+			std::shared_ptr<Mirror> ref;
+			if (inBand(mirror->getRowIndex())) {
+				ref = getMirror(mirror->getRowIndex(), mirror->getColumnIndex());
+				if (ref.get() == nullptr) {
+					storeMirror(mirror);
+				}
+				else {
+					std::cout << "Mirror: Row: " << ref->getRowIndex() << " Column: " << ref->getColumnIndex() << std::endl;
+					throw std::logic_error("Duplicate Mirror");
+				}
 			}
 
 			/// Reference Mirror at top left diagonally adjacent column with 90 degree deflection 
-			if ((mirror->getRowIndex() - 1) > -1 && (mirror->getColumnIndex() - 1) > -1) {
-				ref = _mirrors[((mirror->getRowIndex() - 1) * _maxColumns) + mirror->getColumnIndex() - 1];
+			if ((mirror->getRowIndex() - 1) > -1 && (mirror->getColumnIndex() - 1) > -1 && inBand(mirror->getRowIndex() - 1)) {
+				ref = getMirror(mirror->getRowIndex() - 1, mirror->getColumnIndex() - 1);
 				if (ref.get() != nullptr) {
-					ref->setDeflectionAngle(ref->getdeflectionAngle() + -90);
+					turnMirror(ref->getRowIndex(), ref->getColumnIndex(), -90);
 				}
 				else {
 					std::shared_ptr<Mirror> ref1 = std::make_shared<Mirror>(*mirror);
 					ref1->setDeflectionAngle(-90);
 					ref1->setColumnIndex(mirror->getColumnIndex() - 1);
 					ref1->setRowIndex(mirror->getRowIndex() - 1);
-					_mirrors[(ref1->getRowIndex() * _maxColumns) + ref1->getColumnIndex()] = ref1;
+					storeMirror(ref1);
 				}
 			}
 
 			/// Reference Mirror at top right diagonally adjacent column with 90 degree deflection
-			if ((mirror->getRowIndex() - 1) > -1 && (mirror->getColumnIndex() + 1) < _maxColumns) {
-				ref = _mirrors[((mirror->getRowIndex() - 1) * _maxColumns) + mirror->getColumnIndex() + 1];
+			if ((mirror->getRowIndex() - 1) > -1 && (mirror->getColumnIndex() + 1) < _maxColumns && inBand(mirror->getRowIndex() - 1)) {
+				ref = getMirror(mirror->getRowIndex() - 1, mirror->getColumnIndex() + 1);
 				if (ref.get() != nullptr) {
-					ref->setDeflectionAngle(ref->getdeflectionAngle() + -90);
+					turnMirror(ref->getRowIndex(), ref->getColumnIndex(), -90);
 				}
 				else {
 					std::shared_ptr<Mirror> ref2 = std::make_shared<Mirror>(*mirror);
 					ref2->setDeflectionAngle(-90);
 					ref2->setColumnIndex(mirror->getColumnIndex() + 1);
 					ref2->setRowIndex(mirror->getRowIndex() - 1);
-					_mirrors[(ref2->getRowIndex() * _maxColumns) + ref2->getColumnIndex()] = ref2;
+					storeMirror(ref2);
 				}
 			}
 
 			/// Reference Mirror at bottom left diagonally adjacent column with 90 degree deflection 
-			if ((mirror->getRowIndex() + 1) < _maxColumns && (mirror->getColumnIndex() - 1) > -1) {
-				ref = _mirrors[((mirror->getRowIndex() + 1) * _maxColumns) + mirror->getColumnIndex() - 1];
+			if ((mirror->getRowIndex() + 1) < _maxColumns && (mirror->getColumnIndex() - 1) > -1 && inBand(mirror->getRowIndex() + 1)) {
+				ref = getMirror(mirror->getRowIndex() + 1, mirror->getColumnIndex() - 1);
 				if (ref.get() != nullptr) {
-					ref->setDeflectionAngle(ref->getdeflectionAngle() + 90);
+					turnMirror(ref->getRowIndex(), ref->getColumnIndex(), 90);
 				}
 				else {
 					std::shared_ptr<Mirror> ref3 = std::make_shared<Mirror>(*mirror);
 					ref3->setDeflectionAngle(90);
 					ref3->setColumnIndex(mirror->getColumnIndex() - 1);
 					ref3->setRowIndex(mirror->getRowIndex() + 1);
-					_mirrors[(ref3->getRowIndex() * _maxColumns) + ref3->getColumnIndex()] = ref3;
+					storeMirror(ref3);
 				}
 			}
 
 			/// Reference Mirror at bottom right diagonally adjacent column with 90 degree deflection 
-			if ((mirror->getRowIndex() + 1) < _maxColumns && (mirror->getColumnIndex() + 1) < _maxColumns) {
-				ref = _mirrors[((mirror->getRowIndex() + 1) * _maxColumns) + mirror->getColumnIndex() + 1];
+			if ((mirror->getRowIndex() + 1) < _maxColumns && (mirror->getColumnIndex() + 1) < _maxColumns && inBand(mirror->getRowIndex() + 1)) {
+				ref = getMirror(mirror->getRowIndex() + 1, mirror->getColumnIndex() + 1);
 				if (ref.get() != nullptr) {
-					ref->setDeflectionAngle(ref->getdeflectionAngle() + 90);
+					turnMirror(ref->getRowIndex(), ref->getColumnIndex(), 90);
 				}
 				else {
 					std::shared_ptr<Mirror> ref4 = std::make_shared<Mirror>(*mirror);
 					ref4->setDeflectionAngle(90);
 					ref4->setColumnIndex(mirror->getColumnIndex() + 1);
 					ref4->setRowIndex(mirror->getRowIndex() + 1);
-					_mirrors[(ref4->getRowIndex() * _maxColumns) + ref4->getColumnIndex()] = ref4;
+					storeMirror(ref4);
 				}
 			}
 		}
 
 		/**
-		 * @brief      { Simple function to print the RayBox with Mirror location }
+		 * @brief      { Deletion of mirror when mirror strength reduces to zero. Nothing is deleted
+		 * 				when the cell holds another mirror by now: AddMirror may have turned a copy
+		 * 				into the cell while a relaxed ray was using up the mirror }
 		 *
-		 * @param      out   Ostream 
+		 * @param[in]  mirror    The evaporated mirror
+		 * @param[in]  rowIndex  The row index
+		 * @param[in]  colIndex  The col index
 		 */
-		void print(std::ostream& out) {
-			for (auto itr : _mirrors) {
-				if (itr.get() != nullptr)
-					out << itr->getRowIndex() << "," << itr->getColumnIndex() << "," 
-					<< itr->getStrength() << "," << static_cast<int>(itr->getdeflectionAngle())
-					<< std::endl;
+		void deleteMirror(const Mirror* mirror, int rowIndex, int colIndex) {
+			if (getMirror(rowIndex, colIndex).get() != mirror)
+				return;
+			MirrorList& row = _rows[rowIndex - _rowBegin];
+			row.erase(atColumn(row, colIndex));
+			MirrorList& column = _columns[colIndex];
+			column.erase(atRow(column, rowIndex));
+
+			Version* next = nullptr;
+			updateRow(next, rowIndex);
+			updateColumn(next, colIndex);
+			publish(next);
+			_epochs.reclaim();
+		}
+
+		/**
+		 * @brief      { Stores mirror in its row and column lists, replacing mirror of same cell }
+		 *
+		 * @param[in]  mirror  The mirror
+		 */
+		void storeMirror(const std::shared_ptr<Mirror>& mirror) {
+			MirrorList& row = _rows[mirror->getRowIndex() - _rowBegin];
+			auto inRow = atColumn(row, mirror->getColumnIndex());
+			MirrorList& column = _columns[mirror->getColumnIndex()];
+			auto inColumn = atRow(column, mirror->getRowIndex());
+			if (inRow != row.end() && (*inRow)->getColumnIndex() == mirror->getColumnIndex()) {
+				*inRow = mirror;
+				*inColumn = mirror;
+			}
+			else {
+				row.insert(inRow, mirror);
+				column.insert(inColumn, mirror);
 			}
 		}
 
 		/**
-		 * @brief      { Manages references to MirrorList, so that processing can be improved. }
+		 * @brief      { First mirror of a row list at or after a column }
 		 */
-		void initReferences() {
-			initRowReferences(_rowRefMirrorList);
-			initColReferences(_colRefMirrorList);
+		static inline MirrorList::iterator atColumn(MirrorList& row, int colIndex) {
+			return std::lower_bound(row.begin(), row.end(), colIndex,
+				[](const std::shared_ptr<Mirror>& mirror, int index) { return mirror->getColumnIndex() < index; });
 		}
 
-		inline int getSize() {
-			return _maxColumns;
+		/**
+		 * @brief      { First mirror of a column list at or after a row }
+		 */
+		static inline MirrorList::iterator atRow(MirrorList& column, int rowIndex) {
+			return std::lower_bound(column.begin(), column.end(), rowIndex,
+				[](const std::shared_ptr<Mirror>& mirror, int index) { return mirror->getRowIndex() < index; });
 		}
 
-	private:
-		
 		/**
-		 * @brief      { Deletion of mirror when mirror strength reduces to zero }
+		 * @brief      { Turns mirror of a cell. Mirror in a published list is not changed, as
+		 * 				readers may be using it; a turned copy takes its cell }
 		 *
 		 * @param[in]  rowIndex  The row index
 		 * @param[in]  colIndex  The col index
+		 * @param[in]  angle     The angle added to deflection
 		 */
-		void deleteMirror(int rowIndex, int colIndex) {
-			_mirrors[(rowIndex * _maxColumns) + colIndex].reset();
-			MirrorList list = _rowRefMirrorList[rowIndex];
-			MirrorList::iterator itrRef = list.end();
-			for (auto itr = list.begin(); itr != list.end(); itr++) {
-				if (itr->get() != nullptr && (*itr)->getColumnIndex() == colIndex) {
-					(*itr).reset();
-					itrRef = itr;
-				}
-			}
-			if (itrRef != list.end()) {
-				list.erase(itrRef);
-				_rowRefMirrorList[rowIndex] = list;
+		void turnMirror(int rowIndex, int colIndex, int angle) {
+			std::shared_ptr<Mirror> mirror = getMirror(rowIndex, colIndex);
+			const Version* current = _version.load();
+			if (current->row(rowIndex - _rowBegin) != nullptr || current->column(colIndex) != nullptr) {
+				mirror = std::make_shared<Mirror>(*mirror);
+				storeMirror(mirror);
 			}
+			mirror->setDeflectionAngle(mirror->getdeflectionAngle() + angle);
+		}
 
-			list = _colRefMirrorList[colIndex];
-			itrRef = list.end();
-			for (auto itr = list.begin(); itr != list.end(); itr++) {
-				if (itr->get() != nullptr && (*itr)->getRowIndex() == rowIndex) {
-					(*itr).reset();
-					itrRef = itr;
-				}
-			}
-			if (itrRef != list.end()) {
-				list.erase(itrRef);
-				_colRefMirrorList[colIndex] = list;
-			}
+		/**
+		 * @brief      { Rebuilds a row list in the next version, which is started as a copy of the
+		 * 				current one on first change. Lists not built yet are skipped, they will be
+		 * 				built from mirror storage as it is then }
+		 *
+		 * @param      next      The next version, nullptr while nothing changed
+		 * @param[in]  rowIndex  The row index
+		 */
+		void updateRow(Version*& next, int rowIndex) {
+			const Version* current = _version.load();
+			if (current->row(rowIndex - _rowBegin) == nullptr)
+				return;
+			if (next == nullptr)
+				next = new Version(*current);
+			setLine(next->_rows, current->_rows, rowIndex - _rowBegin, buildRow(rowIndex));
+		}
+
+		/**
+		 * @brief      { Rebuilds a column list in the next version, see updateRow }
+		 *
+		 * @param      next      The next version, nullptr while nothing changed
+		 * @param[in]  colIndex  The col index
+		 */
+		void updateColumn(Version*& next, int colIndex) {
+			const Version* current = _version.load();
+			if (current->column(colIndex) == nullptr)
+				return;
+			if (next == nullptr)
+				next = new Version(*current);
+			setLine(next->_columns, current->_columns, colIndex, buildColumn(colIndex));
+		}
+
+		/**
+		 * @brief      { Stores list of a line in next version, copying its chunk first when the
+		 * 				chunk is still shared with current version }
+		 *
+		 * @param      chunks   Chunks of next version
+		 * @param[in]  current  Chunks of current version
+		 * @param[in]  line     The line
+		 * @param      list     The list
+		 */
+		static void setLine(std::vector<std::shared_ptr<Chunk>>& chunks,
+			const std::vector<std::shared_ptr<Chunk>>& current, int line, MirrorList* list) {
+			std::shared_ptr<Chunk>& chunk = chunks[line / ChunkLines];
+			if (chunk == current[line / ChunkLines])
+				chunk = std::make_shared<Chunk>(*chunk);
+			chunk->_lines[line % ChunkLines].reset(list);
+		}
+
+		/**
+		 * @brief      { Publishes new board version, old version is freed when no reader uses it }
+		 *
+		 * @param      next  The new version, nothing is published when nullptr
+		 */
+		void publish(Version* next) {
+			if (next == nullptr)
+				return;
+			_epochs.retire(_version.exchange(next));
 		}
 
 		/**
@@ -190,144 +585,218 @@ namespace RayBox {
 		 *
 		 * @param      mirror  The mirror
 		 * @param      ray     The ray
+		 * @param      result  The result, filled when the ray stops at the mirror
+		 * @param[in]  mode    How the trace may change the board
+		 *
+		 * @return     { true when ray is deflected and has to be passed further }
 		 */
-		void deflectMirror(std::shared_ptr<Mirror>& mirror, Ray& ray) {
-			Mirror::DeflectionResult ret = mirror->deflectRay(ray);
-			if (ret == Mirror::DeflectionResult::Deflected)
-				PassTheRay(ray);
-			else if (ret == Mirror::DeflectionResult::Hit)
-				std::cout << "{" << ray._row + 1 << "," << ray._column + 1 << "}" << std::endl;
-			else if (ret == Mirror::DeflectionResult::Evaporated) {
-				std::cout << "{" << ray._row + 1 << "," << ray._column + 1 << "}" << std::endl;
-				deleteMirror(mirror->getRowIndex(), ray._column);
+		bool deflectMirror(Mirror* mirror, Ray& ray, RayResult& result, const TraceMode mode) {
+			Mirror::DeflectionResult ret = mirror->deflectRay(ray, mode != TraceMode::Query);
+			if (ret == Mirror::DeflectionResult::Deflected) {
+				result._hops++;
+				return true;
 			}
+			if (ret == Mirror::DeflectionResult::Passed)
+				return true;
+
+			result._row = ray._row + 1;
+			result._column = ray._column + 1;
+			result._outcome = RayResult::Outcome::Absorbed;
+			if (ret == Mirror::DeflectionResult::Evaporated) {
+				result._outcome = RayResult::Outcome::Evaporated;
+				if (mode == TraceMode::Relaxed) {
+					std::lock_guard<std::mutex> lock(_writeLock);
+					deleteMirror(mirror, mirror->getRowIndex(), ray._column);
+				}
+				else
+					deleteMirror(mirror, mirror->getRowIndex(), ray._column);
+			}
+			return false;
 		}
 
 		/**
 		 * @brief      { Processing row as per Top to Bottom direction. }
 		 *
-		 * @param      ray   The ray
+		 * @param      version  The board version traced
+		 * @param      ray      The ray
+		 * @param      result   The result, filled when the ray leaves the box
+		 *
+		 * @return     { Mirror hit by the ray, nullptr when it leaves the box }
 		 */
-		void PassFromTopToBottom(Ray& ray) noexcept {
-			MirrorList list = _colRefMirrorList[ray._column];
-			if (list.size() > 0) {
-				auto itr = list.cbegin();
-				for (; itr != list.cend(); itr++) {
-					std::shared_ptr<Mirror> mirror = *itr;
-					if (mirror.get() != nullptr) {
-						if (mirror->getRowIndex() < ray._row)
-							continue;
-						ray._row = mirror->getRowIndex();
-						deflectMirror(mirror, ray);
-						break;
-					}
+		Mirror* PassFromTopToBottom(Version& version, Ray& ray, RayResult& result) noexcept {
+			/// Ray reversed just above the band starts in the band above
+			if (ray._row < _rowBegin && _rowBegin > 0) {
+				result._outcome = RayResult::Outcome::HandedOff;
+				return nullptr;
+			}
+			const MirrorList& list = colReferences(version, ray._column);
+			for (auto itr = list.cbegin(); itr != list.cend(); itr++) {
+				if (itr->get() != nullptr) {
+					if ((*itr)->getRowIndex() < ray._row)
+						continue;
+					ray._row = (*itr)->getRowIndex();
+					return itr->get();
 				}
-				if (itr == list.end())
-					std::cout << "{" << _maxColumns << "," << ray._column + 1 << "}" << std::endl;
 			}
-			else
-				std::cout << "{" << _maxColumns << "," << ray._column + 1 << "}" << std::endl;
+			if (_rowEnd < _maxColumns) {
+				ray._row = _rowEnd;
+				result._outcome = RayResult::Outcome::HandedOff;
+				return nullptr;
+			}
+			result._row = _maxColumns;
+			result._column = ray._column + 1;
+			result._outcome = RayResult::Outcome::Exited;
+			return nullptr;
 		}
 
 		/**
 		 * @brief      { Processing row as per Bottom to Top direction. }
 		 *
-		 * @param      ray   The ray
+		 * @param      version  The board version traced
+		 * @param      ray      The ray
+		 * @param      result   The result, filled when the ray leaves the box
+		 *
+		 * @return     { Mirror hit by the ray, nullptr when it leaves the box }
 		 */
-		void PassFromBottomToTop(Ray& ray) noexcept  {
-			MirrorList list = _colRefMirrorList[ray._column];
-			if (list.size() > 0) {
-				auto itr = list.crbegin();
-				for (; itr != list.crend(); itr++) {
-					std::shared_ptr<Mirror> mirror = *itr;
-					if (mirror.get() != nullptr) {
-						if (mirror->getRowIndex() > ray._row)
-							continue;
-						ray._row = mirror->getRowIndex();
-						deflectMirror(mirror, ray);
-						break;
-					}
+		Mirror* PassFromBottomToTop(Version& version, Ray& ray, RayResult& result) noexcept  {
+			/// Ray reversed just below the band starts in the band below
+			if (ray._row >= _rowEnd && _rowEnd < _maxColumns) {
+				result._outcome = RayResult::Outcome::HandedOff;
+				return nullptr;
+			}
+			const MirrorList& list = colReferences(version, ray._column);
+			for (auto itr = list.crbegin(); itr != list.crend(); itr++) {
+				if (itr->get() != nullptr) {
+					if ((*itr)->getRowIndex() > ray._row)
+						continue;
+					ray._row = (*itr)->getRowIndex();
+					return itr->get();
 				}
-				if (itr == list.rend())
-					std::cout << "{" << 0 << "," << ray._column + 1 << "}" << std::endl;
 			}
-			else
-				std::cout << "{" << 0 << "," << ray._column + 1 << "}" << std::endl;
+			if (_rowBegin > 0) {
+				ray._row = _rowBegin - 1;
+				result._outcome = RayResult::Outcome::HandedOff;
+				return nullptr;
+			}
+			result._row = 0;
+			result._column = ray._column + 1;
+			result._outcome = RayResult::Outcome::Exited;
+			return nullptr;
 		}
 
 		/**
 		 * @brief      { Processing row as per Left to Right direction.  }
 		 *
-		 * @param      ray   The ray
+		 * @param      version  The board version traced
+		 * @param      ray      The ray
+		 * @param      result   The result, filled when the ray leaves the box
+		 *
+		 * @return     { Mirror hit by the ray, nullptr when it leaves the box }
 		 */
-		void PassFromLeftToRight(Ray& ray) noexcept  {
-			MirrorList list = _rowRefMirrorList[ray._row];
-			if (list.size() > 0) {
-				auto itr = list.cbegin();
-				for (; itr != list.cend(); itr++) {
-					std::shared_ptr<Mirror> mirror = *itr;
-					if (mirror.get() != nullptr) {
-						if (mirror->getColumnIndex() < ray._column)
-							continue;
-						ray._column = mirror->getColumnIndex();
-						deflectMirror(mirror, ray);
-						break;
-					}
+		Mirror* PassFromLeftToRight(Version& version, Ray& ray, RayResult& result) noexcept  {
+			const MirrorList& list = rowReferences(version, ray._row);
+			for (auto itr = list.cbegin(); itr != list.cend(); itr++) {
+				if (itr->get() != nullptr) {
+					if ((*itr)->getColumnIndex() < ray._column)
+						continue;
+					ray._column = (*itr)->getColumnIndex();
+					return itr->get();
 				}
-				if (itr == list.end())
-					std::cout << "{" << ray._row + 1 << "," << _maxColumns << "}" << std::endl;
 			}
-			else
-				std::cout << "{" << ray._row + 1 << "," << _maxColumns << "}" << std::endl;
+			result._row = ray._row + 1;
+			result._column = _maxColumns;
+			result._outcome = RayResult::Outcome::Exited;
+			return nullptr;
 		}
 
 		/**
 		 * @brief      { Processing row as per Right to Left direction.  }
 		 *
-		 * @param      ray   The ray
+		 * @param      version  The board version traced
+		 * @param      ray      The ray
+		 * @param      result   The result, filled when the ray leaves the box
+		 *
+		 * @return     { Mirror hit by the ray, nullptr when it leaves the box }
 		 */
-		void PassFromRightToLeft(Ray& ray) noexcept  {
-			MirrorList list = _rowRefMirrorList[ray._row];
-			if (list.size() > 0) {
-				auto itr = list.crbegin();
-				for (; itr != list.crend(); itr++) {
-					std::shared_ptr<Mirror> mirror = *itr;
-					if (mirror.get() != nullptr) {
-						if (mirror->getColumnIndex() > ray._column)
-							continue;
-						ray._column = mirror->getColumnIndex();
-						deflectMirror(mirror, ray);
-						break;
-					}
+		Mirror* PassFromRightToLeft(Version& version, Ray& ray, RayResult& result) noexcept  {
+			const MirrorList& list = rowReferences(version, ray._row);
+			for (auto itr = list.crbegin(); itr != list.crend(); itr++) {
+				if (itr->get() != nullptr) {
+					if ((*itr)->getColumnIndex() > ray._column)
+						continue;
+					ray._column = (*itr)->getColumnIndex();
+					return itr->get();
 				}
-				if (itr == list.rend())
-					std::cout << "{" << ray._row + 1 << "," << 0 << "}" << std::endl;
 			}
-			else
-				std::cout << "{" << ray._row + 1 << "," << 0 << "}" << std::endl;
+			result._row = ray._row + 1;
+			result._column = 0;
+			result._outcome = RayResult::Outcome::Exited;
+			return nullptr;
 		}
 
-		void initRowReferences(std::vector<MirrorList>& list) {
-			for (auto itr : _mirrors) {
-				if (itr.get() != nullptr) {
-					list[itr->getRowIndex()].push_back(itr);
-				}
+		/**
+		 * @brief      { Returns mirrors of a row, building the list on first use in lazy mode.
+		 * 				Lazy mode has no concurrent readers, so the list is stored in place }
+		 *
+		 * @param      version   The board version traced
+		 * @param[in]  rowIndex  The row index
+		 */
+		inline const MirrorList& rowReferences(Version& version, int rowIndex) {
+			const MirrorList* list = version.row(rowIndex - _rowBegin);
+			if (list == nullptr) {
+				list = buildRow(rowIndex);
+				version.setRow(rowIndex - _rowBegin, list);
 			}
+			return *list;
 		}
 
-		void initColReferences(std::vector<MirrorList>& list) {
-			for (auto itr : _mirrors) {
-				if (itr.get() != nullptr) {
-					list[itr->getColumnIndex()].push_back(itr);
-				}
+		/**
+		 * @brief      { Returns mirrors of a column, building the list on first use in lazy mode }
+		 *
+		 * @param      version   The board version traced
+		 * @param[in]  colIndex  The col index
+		 */
+		inline const MirrorList& colReferences(Version& version, int colIndex) {
+			const MirrorList* list = version.column(colIndex);
+			if (list == nullptr) {
+				list = buildColumn(colIndex);
+				version.setColumn(colIndex, list);
 			}
+			return *list;
+		}
+
+		MirrorList* buildRow(int rowIndex) {
+			return new MirrorList(_rows[rowIndex - _rowBegin]);
+		}
+
+		MirrorList* buildColumn(int colIndex) {
+			return new MirrorList(_columns[colIndex]);
+		}
+
+		/**
+		 * @brief      { New board version with every row and column list built }
+		 */
+		Version* buildVersion() {
+			Version* version = new Version(_rowEnd - _rowBegin, _maxColumns);
+			for (int row = _rowBegin; row < _rowEnd; row++)
+				version->setRow(row - _rowBegin, buildRow(row));
+			for (int col = 0; col < _maxColumns; col++)
+				version->setColumn(col, buildColumn(col));
+			return version;
 		}
 
 	private:
 		int													_maxColumns;
-		MirrorList											_mirrors;
-		std::vector<MirrorList>								_rowRefMirrorList;
-		std::vector<MirrorList>								_colRefMirrorList;
+		int													_rowBegin;
+		int													_rowEnd;
+		/// Mirror storage, row lists sorted by column and column lists sorted by row
+		std::vector<MirrorList>								_rows;
+		std::vector<MirrorList>								_columns;
+		/// Published board version, lists are nullptr while not built
+		std::atomic<Version*>								_version;
+		bool												_lazyReferences;
+		std::mutex											_writeLock;
+		EpochManager										_epochs;
 	};
 
 }
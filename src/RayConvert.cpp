@@ -0,0 +1,77 @@
+// RayConvert.cpp : Converts ray input and result files between text and binary formats.
+//
+
+#include <fstream>
+#include <functional>
+
+#include "BinaryFormat.hpp"
+#include "ConfigFileReader.hpp"
+#include "ResultWriter.hpp"
+using namespace RayBox;
+
+
+
+int main(int argc, char** argv)
+{
+	if (argc != 5) {
+		std::cout << "Usage: <RayConvert> <rays|results> <text|binary> <InputFile> <OutputFile>" << std::endl;
+		std::cout << "       second argument is the format to convert to" << std::endl;
+		return 1;
+	}
+
+	std::string kind(argv[1]);
+	std::string format(argv[2]);
+	if ((kind != "rays" && kind != "results") || (format != "text" && format != "binary")) {
+		std::cout << "Invalid conversion: " << kind.c_str() << " to " << format.c_str() << std::endl;
+		return 1;
+	}
+
+	std::string inputFile(argv[3]);
+	std::ofstream out(argv[4], std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!out.is_open()) {
+		std::cout << "Unable to open " << argv[4] << std::endl;
+		return 1;
+	}
+
+	try {
+		if (kind == "rays" && format == "binary") {
+			if (!ConfigReader::fileReader(inputFile, [&](std::string& line) {
+				RayInput input;
+				if (!ConfigReader::parseRayLine(line, input))
+					return;
+				char record[BinaryFormat::RayRecordSize];
+				BinaryFormat::encodeRay(input, record);
+				out.write(record, sizeof(record));
+			}))
+				return 1;
+		}
+		else if (kind == "rays") {
+			BinaryFormat::fileReader(inputFile, BinaryFormat::RayRecordSize, [&](const char* record) {
+				out << ConfigReader::formatRay(BinaryFormat::decodeRay(record)) << '\n';
+			});
+		}
+		else if (format == "binary") {
+			/// Text results carry no hop count, and no outcome but the unknown mark
+			ResultWriter writer(out, ResultWriter::Format::Binary);
+			if (!ConfigReader::fileReader(inputFile, [&](std::string& line) {
+				RayResult result;
+				if (ConfigReader::parseResultLine(line, result))
+					writer.write(std::string(), result);
+			}))
+				return 1;
+		}
+		else {
+			ResultWriter writer(out, ResultWriter::Format::Text);
+			BinaryFormat::fileReader(inputFile, BinaryFormat::ResultRecordSize, [&](const char* record) {
+				writer.write(std::string(), BinaryFormat::decodeResult(record));
+			});
+		}
+	}
+	catch (std::exception& ex) {
+		std::cerr << "error while reading " << inputFile.c_str() << ": " << ex.what() << std::endl;
+		return 1;
+	}
+
+	out.close();
+	return 0;
+}
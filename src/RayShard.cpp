@@ -0,0 +1,43 @@
+// RayShard.cpp : Serves one band of a board to RayBox coordinators, see ShardedRaybox.
+//
+
+#include <cstdio>
+#include <string>
+
+#include "ShardedRaybox.hpp"
+using namespace RayBox;
+
+
+
+int main(int argc, char** argv)
+{
+	if (argc != 4 && argc != 5) {
+		std::cout << "Usage: <RayShard> <ConfigFileName> <Address> <Shard>/<Shards> [--lazy]" << std::endl;
+		std::cout << "       address is a Unix socket path or host:port, shards are numbered from 0" << std::endl;
+		return 1;
+	}
+
+	int shard = -1;
+	int shards = 0;
+	if (sscanf(argv[3], "%d/%d", &shard, &shards) != 2 || shard < 0 || shard >= shards) {
+		std::cout << "Invalid shard: " << argv[3] << std::endl;
+		return 1;
+	}
+	bool lazy = false;
+	if (argc == 5) {
+		if (std::string(argv[4]) != "--lazy") {
+			std::cout << "Unknown option: " << argv[4] << std::endl;
+			return 1;
+		}
+		lazy = true;
+	}
+
+	try {
+		ShardedRaybox::serve(argv[1], argv[2], shard, shards, lazy);
+	}
+	catch (std::exception& ex) {
+		std::cerr << "Error RayShard : " << ex.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,69 @@
+#ifndef RELAXED_TRACER_HPP
+#define RELAXED_TRACER_HPP
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "EpochManager.hpp"
+#include "Ray.hpp"
+#include "RayBox.hpp"
+
+namespace RayBox {
+
+	/**
+	 * @brief      Class for tracing rays on many threads against a board which changes, mirrors
+	 * 				evaporating as their strength is used up ( see Raybox::PassTheRayRelaxed ).
+	 * 				Threads take rays from the input in turn and results are stored in input order,
+	 * 				but rays are not traced in input order: which ray evaporates a mirror, and so
+	 * 				results of rays reaching it, may differ from serial engine and between runs.
+	 */
+	class RelaxedTracer {
+	public:
+
+		/**
+		 * @brief      { Constructor, claims a reader slot for every thread. Threads are capped at
+		 * 				EpochManager::MaxReaders; running out of slots throws here, not in a thread }
+		 *
+		 * @param      rayBox   The ray box
+		 * @param[in]  threads  The threads
+		 */
+		RelaxedTracer(Raybox& rayBox, const int threads) throw(std::logic_error) : _rayBox(rayBox) {
+			int count = threads < 1 ? 1 : (threads > EpochManager::MaxReaders ? EpochManager::MaxReaders : threads);
+			for (int thread = 0; thread < count; thread++)
+				_readers.emplace_back(new EpochManager::Reader(rayBox.getEpochs()));
+		}
+
+		/**
+		 * @brief      { Traces all rays, results are stored in input order }
+		 *
+		 * @param[in]  rays     The rays
+		 * @param[out] results  The results
+		 */
+		void trace(const std::vector<Ray>& rays, std::vector<RayResult>& results) {
+			results.resize(rays.size());
+			std::atomic<size_t> next(0);
+
+			std::vector<std::thread> workers;
+			for (auto& slot : _readers) {
+				EpochManager::Reader* reader = slot.get();
+				workers.push_back(std::thread([&, reader]() {
+					for (size_t i = next++; i < rays.size(); i = next++) {
+						Ray ray = rays[i];
+						results[i] = _rayBox.PassTheRayRelaxed(ray, *reader);
+					}
+				}));
+			}
+			for (auto& worker : workers)
+				worker.join();
+		}
+
+	private:
+		Raybox&												_rayBox;
+		std::vector<std::unique_ptr<EpochManager::Reader>>	_readers;
+	};
+
+}
+
+#endif //RELAXED_TRACER_HPP
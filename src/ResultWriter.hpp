@@ -0,0 +1,64 @@
+#ifndef RESULT_WRITER_HPP
+#define RESULT_WRITER_HPP
+
+#include <iostream>
+#include <string>
+
+#include "BinaryFormat.hpp"
+#include "Ray.hpp"
+
+namespace RayBox {
+
+	/**
+	 * @brief      Class for writing ray results, either as text ( C7+ -> {3,7} )
+	 * 				or as fixed width binary records ( see BinaryFormat ).
+	 * 				Text of a ray stopped as Unknown, e.g. in an endless cycle, is marked:
+	 * 				C6- -> {8,6} unknown
+	 */
+	class ResultWriter {
+	public:
+		enum class Format {
+			Text										= 0,
+			Binary
+		};
+
+		/// Mark of text result with Unknown outcome
+		static constexpr const char* UnknownMark			= " unknown";
+
+		ResultWriter(std::ostream& out, const Format format) : _out(out), _format(format) {
+		}
+
+		~ResultWriter() {
+			_out.flush();
+		}
+
+		/**
+		 * @brief      { Writes one result }
+		 *
+		 * @param[in]  label   The ray as given in input, used by text format only
+		 * @param[in]  result  The result
+		 */
+		void write(const std::string& label, const RayResult& result) {
+			if (_format == Format::Binary) {
+				char record[BinaryFormat::ResultRecordSize];
+				BinaryFormat::encodeResult(result, record);
+				_out.write(record, sizeof(record));
+				return;
+			}
+
+			if (!label.empty())
+				_out << label << " -> ";
+			_out << "{" << result._row << "," << result._column << "}";
+			if (result._outcome == RayResult::Outcome::Unknown)
+				_out << UnknownMark;
+			_out << '\n';
+		}
+
+	private:
+		std::ostream&									_out;
+		Format											_format;
+	};
+
+}
+
+#endif //RESULT_WRITER_HPP
@@ -0,0 +1,619 @@
+#ifndef SHARDED_RAYBOX_HPP
+#define SHARDED_RAYBOX_HPP
+
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "ConfigFileReader.hpp"
+#include "Ray.hpp"
+#include "RayBox.hpp"
+
+namespace RayBox {
+
+	/**
+	 * @brief      Class for running a board split in bands of rows, each band owned by a
+	 * 				separate shard process running its own Raybox.
+	 * 				Shards are either forked here and connected with Unix socket pairs, every
+	 * 				shard with the coordinator ( this object ) and with the shards owning bands
+	 * 				above and below; or they are shard servers ( see serve ) started on their own,
+	 * 				on this or other hosts, which the coordinator connects to by address.
+	 * 				A ray is sent to the shard owning its entry row; when it leaves the band
+	 * 				vertically that shard hands it off to its neighbour, through the coordinator
+	 * 				when shards are not linked, and the shard where the ray finishes sends the
+	 * 				result back to the coordinator.
+	 *
+	 * 				Addresses are a Unix socket path, or host:port for TCP.
+	 *
+	 * 				Results are same as a single Raybox: rays are traced one at a time when a
+	 * 				mirror can evaporate, and a window of rays is kept in flight when board is static.
+	 */
+	class ShardedRaybox {
+	public:
+
+		/**
+		 * @brief      { Starts shard processes, each loading its band of configuration file }
+		 *
+		 * @param[in]  configFile  The configuration file
+		 * @param[in]  shards      Number of shards
+		 * @param[in]  lazy        Build mirror references lazily, see Raybox::initReferences
+		 */
+		ShardedRaybox(const std::string& configFile, const int shards, const bool lazy) throw(std::logic_error)
+			: _size(ConfigReader::readBoardSize(configFile)), _static(true) {
+			if (_size < 1)
+				throw std::logic_error("invalid input column size");
+			_shards = shards < _size ? shards : _size;
+
+			/// Neighbour links: shard k talks to shard k + 1 over neighbours[k]
+			std::vector<int> coordinator(2 * _shards, -1);
+			std::vector<int> neighbours(2 * _shards, -1);
+			for (int shard = 0; shard < _shards; shard++) {
+				if (socketpair(AF_UNIX, SOCK_STREAM, 0, &coordinator[2 * shard]) != 0)
+					throw std::logic_error("Unable to create shard socket");
+				if (shard + 1 < _shards && socketpair(AF_UNIX, SOCK_STREAM, 0, &neighbours[2 * shard]) != 0)
+					throw std::logic_error("Unable to create shard socket");
+			}
+
+			/// Buffered output would be written again by every shard process
+			std::cout.flush();
+			for (int shard = 0; shard < _shards; shard++) {
+				pid_t pid = fork();
+				if (pid < 0)
+					throw std::logic_error("Unable to start shard");
+				if (pid == 0) {
+					int own = coordinator[(2 * shard) + 1];
+					int up = shard > 0 ? neighbours[(2 * (shard - 1)) + 1] : -1;
+					int down = neighbours[2 * shard];
+					for (int fd : coordinator)
+						if (fd != own && fd >= 0)
+							close(fd);
+					for (int fd : neighbours)
+						if (fd != up && fd != down && fd >= 0)
+							close(fd);
+					int status = 0;
+					try {
+						runShard(configFile, shard, _shards, lazy, own, up, down);
+					}
+					catch (std::exception& ex) {
+						std::cerr << "Shard " << shard << ": " << ex.what() << std::endl;
+						status = 1;
+					}
+					std::cout.flush();
+					_exit(status);
+				}
+				_pids.push_back(pid);
+			}
+
+			for (int shard = 0; shard < _shards; shard++) {
+				_links.push_back(coordinator[2 * shard]);
+				close(coordinator[(2 * shard) + 1]);
+			}
+			for (int fd : neighbours)
+				if (fd >= 0)
+					close(fd);
+			start();
+		}
+
+		/**
+		 * @brief      { Connects to shard servers, shard k at addresses[k] }
+		 *
+		 * @param[in]  configFile  The configuration file, for side of the board
+		 * @param[in]  addresses   Shard server addresses, one per band in band order
+		 */
+		ShardedRaybox(const std::string& configFile, const std::vector<std::string>& addresses) throw(std::logic_error)
+			: _size(ConfigReader::readBoardSize(configFile)), _shards(static_cast<int>(addresses.size())), _static(true) {
+			if (_size < 1)
+				throw std::logic_error("invalid input column size");
+			if (_shards < 1 || _shards > _size)
+				throw std::logic_error("Number of shard servers must be between 1 and side of the board");
+			for (auto& address : addresses) {
+				try {
+					_links.push_back(connectTo(address));
+				}
+				catch (std::logic_error&) {
+					stop();
+					throw;
+				}
+			}
+			start();
+		}
+
+		~ShardedRaybox() {
+			stop();
+		}
+
+		inline int getSize() {
+			return _size;
+		}
+
+		inline bool isStatic() {
+			return _static;
+		}
+
+		/**
+		 * @brief      { Traces rays across the shards, results are stored in input order }
+		 *
+		 * @param[in]  rays     The rays
+		 * @param[out] results  The results
+		 */
+		void trace(const std::vector<Ray>& rays, std::vector<RayResult>& results) throw(std::logic_error) {
+			results.resize(rays.size());
+			size_t window = 1;
+			if (_static)
+				window = Window;
+
+			std::vector<Link> links(_shards);
+			std::vector<pollfd> fds(_shards);
+			for (int shard = 0; shard < _shards; shard++)
+				links[shard]._fd = _links[shard];
+
+			size_t sent = 0;
+			size_t done = 0;
+			std::vector<Message> received;
+			while (done < rays.size()) {
+				for (; sent < rays.size() && sent - done < window; sent++) {
+					const Ray& ray = rays[sent];
+					Message message = { static_cast<int32_t>(MessageType::Trace), static_cast<int32_t>(sent),
+						ray._row, ray._column, static_cast<int32_t>(ray._direction), 0, 0 };
+					queue(links[owner(ray._row)], message);
+				}
+
+				if (!wait(links, fds))
+					throw std::logic_error("Unable to wait for shards");
+				for (int shard = 0; shard < _shards; shard++) {
+					received.clear();
+					if (!exchange(links[shard], fds[shard], received))
+						throw std::logic_error("Shard is not running");
+					for (auto& message : received) {
+						/// Hand-off of a shard without neighbour links goes on to the owner
+						if (message._type == static_cast<int32_t>(MessageType::Trace)) {
+							queue(links[owner(message._row)], message);
+							continue;
+						}
+						RayResult& result = results[message._sequence];
+						result._row = message._row;
+						result._column = message._column;
+						result._outcome = static_cast<RayResult::Outcome>(message._outcome);
+						result._hops = message._hops;
+						done++;
+					}
+				}
+			}
+		}
+
+		/**
+		 * @brief      { Shard server: listens on address and serves coordinators, each connection
+		 * 				in a process of its own which loads the band afresh. Runs until killed }
+		 *
+		 * @param[in]  configFile  The configuration file
+		 * @param[in]  address     The address
+		 * @param[in]  shard       Band served
+		 * @param[in]  shards      Number of bands
+		 * @param[in]  lazy        Build mirror references lazily, see Raybox::initReferences
+		 */
+		static void serve(const std::string& configFile, const std::string& address, const int shard, const int shards,
+			const bool lazy) throw(std::logic_error) {
+			int listener = listenOn(address);
+			/// Connection processes are not waited for, they are reaped by the system
+			signal(SIGCHLD, SIG_IGN);
+			for (;;) {
+				int fd = accept(listener, nullptr, nullptr);
+				if (fd < 0) {
+					if (errno == EINTR || errno == ECONNABORTED)
+						continue;
+					throw std::logic_error("Unable to accept coordinator");
+				}
+				noDelay(fd);
+
+				std::cout.flush();
+				pid_t pid = fork();
+				if (pid < 0)
+					throw std::logic_error("Unable to start shard");
+				if (pid == 0) {
+					close(listener);
+					int status = 0;
+					try {
+						runShard(configFile, shard, shards, lazy, fd, -1, -1);
+					}
+					catch (std::exception& ex) {
+						std::cerr << "Shard " << shard << ": " << ex.what() << std::endl;
+						status = 1;
+					}
+					std::cout.flush();
+					_exit(status);
+				}
+				close(fd);
+			}
+		}
+
+	private:
+
+		/// Rays in flight at once on a static board
+		static const size_t Window							= 1024;
+
+		enum class MessageType : int32_t {
+			Trace										= 0,
+			Result,
+			Ready,
+			Shutdown
+		};
+
+		/**
+		 * @brief      { Fixed size message between processes, a ray or a result. A ray carries
+		 * 				its cycle detection state from band to band. Ready carries load status in
+		 * 				_outcome ( -1 failed, 1 static board, 0 not static ), the band in _row / _column
+		 * 				and side of the board in _hops }
+		 */
+		struct Message {
+			int32_t										_type;
+			int32_t										_sequence;
+			int32_t										_row;
+			int32_t										_column;
+			int32_t										_direction;
+			int32_t										_outcome;
+			int32_t										_hops;
+			RayCycle									_cycle;
+		};
+
+		/**
+		 * @brief      { Socket with bytes waiting to be sent and bytes of a partly received message.
+		 * 				Sends never block, so processes sending to each other can not deadlock on
+		 * 				full socket buffers. }
+		 */
+		struct Link {
+			int											_fd					= -1;
+			std::string									_out;
+			std::string									_in;
+		};
+
+		/**
+		 * @brief      { Shard owning the row }
+		 *
+		 * @param[in]  rowIndex  The row index
+		 */
+		inline int owner(int rowIndex) {
+			int shard = static_cast<int>((static_cast<long long>(rowIndex) * _shards) / _size);
+			while (Raybox::bandBegin(_size, shard + 1, _shards) <= rowIndex)
+				shard++;
+			while (Raybox::bandBegin(_size, shard, _shards) > rowIndex)
+				shard--;
+			return shard;
+		}
+
+		/**
+		 * @brief      { Waits for all shards to be ready. Shards are stopped when one of them
+		 * 				failed, as the board is not constructed then }
+		 */
+		void start() throw(std::logic_error) {
+			try {
+				awaitReady();
+			}
+			catch (std::logic_error&) {
+				stop();
+				throw;
+			}
+		}
+
+		/**
+		 * @brief      { Shuts the shards down, and waits for forked ones to exit }
+		 */
+		void stop() {
+			Message shutdown = { static_cast<int32_t>(MessageType::Shutdown), 0, 0, 0, 0, 0, 0 };
+			for (int fd : _links) {
+				send(fd, shutdown);
+				close(fd);
+			}
+			_links.clear();
+			for (pid_t pid : _pids)
+				waitpid(pid, nullptr, 0);
+			_pids.clear();
+		}
+
+		/**
+		 * @brief      { Every shard reports whether its band loaded, which band it is and whether
+		 * 				it is static. Any failed shard fails the whole board, as config error does
+		 * 				for a single Raybox }
+		 */
+		void awaitReady() throw(std::logic_error) {
+			for (int shard = 0; shard < _shards; shard++) {
+				Message ready;
+				if (!receive(_links[shard], ready) || ready._type != static_cast<int32_t>(MessageType::Ready)
+					|| ready._outcome < 0)
+					throw std::logic_error("Shard " + std::to_string(shard) + " failed to load its band");
+				if (ready._hops != _size || ready._row != Raybox::bandBegin(_size, shard, _shards)
+					|| ready._column != Raybox::bandBegin(_size, shard + 1, _shards))
+					throw std::logic_error("Shard " + std::to_string(shard) + " serves another band or board");
+				_static = _static && ready._outcome == 1;
+			}
+		}
+
+		/**
+		 * @brief      { Shard process: loads its band and serves rays until shutdown }
+		 */
+		static void runShard(const std::string& configFile, const int shard, const int shards, const bool lazy,
+			const int coordinator, const int up, const int down) throw(std::logic_error) {
+			std::shared_ptr<Raybox> rayBox;
+			bool loaded = ConfigReader::fileReader(configFile,
+				std::bind(ConfigReader::parseConfigFile, std::placeholders::_1, std::ref(rayBox), shard, shards));
+
+			Message ready = { static_cast<int32_t>(MessageType::Ready), 0, 0, 0, 0, -1, 0 };
+			if (loaded && rayBox.get() != nullptr) {
+				ready._outcome = rayBox->isStatic() ? 1 : 0;
+				ready._row = Raybox::bandBegin(rayBox->getSize(), shard, shards);
+				ready._column = Raybox::bandBegin(rayBox->getSize(), shard + 1, shards);
+				ready._hops = rayBox->getSize();
+			}
+			send(coordinator, ready);
+			if (ready._outcome < 0)
+				return;
+			rayBox->initReferences(lazy);
+
+			/// Links are coordinator, up and down, missing neighbours are left out
+			std::vector<Link> links;
+			for (int fd : { coordinator, up, down }) {
+				if (fd >= 0) {
+					links.push_back(Link());
+					links.back()._fd = fd;
+				}
+			}
+			Link& toCoordinator = links[0];
+			Link* toUp = up >= 0 ? &links[1] : nullptr;
+			Link* toDown = down >= 0 ? &links.back() : nullptr;
+
+			std::vector<pollfd> fds;
+			std::vector<Message> received;
+			for (;;) {
+				if (!wait(links, fds))
+					throw std::logic_error("Unable to wait for rays");
+				for (size_t link = 0; link < links.size(); link++) {
+					received.clear();
+					bool open = exchange(links[link], fds[link], received);
+					for (auto& message : received) {
+						if (message._type == static_cast<int32_t>(MessageType::Shutdown))
+							return;
+
+						Ray ray;
+						ray._row = message._row;
+						ray._column = message._column;
+						ray._direction = static_cast<Ray::Direction>(message._direction);
+						RayResult result = rayBox->PassTheRay(ray, message._cycle);
+						message._hops += result._hops;
+						if (result._outcome == RayResult::Outcome::HandedOff) {
+							message._row = ray._row;
+							message._column = ray._column;
+							message._direction = static_cast<int32_t>(ray._direction);
+							Link* neighbour = rayBox->inBand(ray._row - 1) ? toDown : toUp;
+							queue(neighbour != nullptr ? *neighbour : toCoordinator, message);
+							continue;
+						}
+						message._type = static_cast<int32_t>(MessageType::Result);
+						message._row = result._row;
+						message._column = result._column;
+						message._outcome = static_cast<int32_t>(result._outcome);
+						queue(toCoordinator, message);
+					}
+					if (!open)
+						return;
+				}
+			}
+		}
+
+		/**
+		 * @brief      { Splits host:port address, Unix socket path otherwise }
+		 *
+		 * @return     { true for a TCP address }
+		 */
+		static bool splitAddress(const std::string& address, std::string& host, std::string& port) {
+			size_t colon = address.rfind(':');
+			if (colon == std::string::npos || address.find('/') != std::string::npos)
+				return false;
+			host = address.substr(0, colon);
+			port = address.substr(colon + 1);
+			return true;
+		}
+
+		static int listenOn(const std::string& address) throw(std::logic_error) {
+			std::string host, port;
+			int fd = -1;
+			if (splitAddress(address, host, port)) {
+				addrinfo hints = addrinfo();
+				hints.ai_family = AF_UNSPEC;
+				hints.ai_socktype = SOCK_STREAM;
+				hints.ai_flags = AI_PASSIVE;
+				addrinfo* found = nullptr;
+				if (getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &found) != 0)
+					throw std::logic_error("Unable to resolve " + address);
+				for (addrinfo* itr = found; itr != nullptr && fd < 0; itr = itr->ai_next) {
+					fd = socket(itr->ai_family, itr->ai_socktype, itr->ai_protocol);
+					int reuse = 1;
+					if (fd >= 0 && (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) != 0
+						|| bind(fd, itr->ai_addr, itr->ai_addrlen) != 0)) {
+						close(fd);
+						fd = -1;
+					}
+				}
+				freeaddrinfo(found);
+			}
+			else {
+				sockaddr_un local = unixAddress(address);
+				/// Socket left by a previous server is replaced, any other file is not
+				struct stat info;
+				if (stat(address.c_str(), &info) == 0 && S_ISSOCK(info.st_mode))
+					unlink(address.c_str());
+				fd = socket(AF_UNIX, SOCK_STREAM, 0);
+				if (fd >= 0 && bind(fd, reinterpret_cast<sockaddr*>(&local), sizeof(local)) != 0) {
+					close(fd);
+					fd = -1;
+				}
+			}
+			if (fd < 0 || listen(fd, 16) != 0)
+				throw std::logic_error("Unable to listen on " + address);
+			return fd;
+		}
+
+		static int connectTo(const std::string& address) throw(std::logic_error) {
+			std::string host, port;
+			int fd = -1;
+			if (splitAddress(address, host, port)) {
+				addrinfo hints = addrinfo();
+				hints.ai_family = AF_UNSPEC;
+				hints.ai_socktype = SOCK_STREAM;
+				addrinfo* found = nullptr;
+				if (getaddrinfo(host.c_str(), port.c_str(), &hints, &found) != 0)
+					throw std::logic_error("Unable to resolve " + address);
+				for (addrinfo* itr = found; itr != nullptr && fd < 0; itr = itr->ai_next) {
+					fd = socket(itr->ai_family, itr->ai_socktype, itr->ai_protocol);
+					if (fd >= 0 && connect(fd, itr->ai_addr, itr->ai_addrlen) != 0) {
+						close(fd);
+						fd = -1;
+					}
+				}
+				freeaddrinfo(found);
+				if (fd >= 0)
+					noDelay(fd);
+			}
+			else {
+				sockaddr_un remote = unixAddress(address);
+				fd = socket(AF_UNIX, SOCK_STREAM, 0);
+				if (fd >= 0 && connect(fd, reinterpret_cast<sockaddr*>(&remote), sizeof(remote)) != 0) {
+					close(fd);
+					fd = -1;
+				}
+			}
+			if (fd < 0)
+				throw std::logic_error("Unable to connect to shard server " + address);
+			return fd;
+		}
+
+		static sockaddr_un unixAddress(const std::string& path) throw(std::logic_error) {
+			sockaddr_un address = sockaddr_un();
+			if (path.empty() || path.size() >= sizeof(address.sun_path))
+				throw std::logic_error("Invalid socket path " + path);
+			address.sun_family = AF_UNIX;
+			std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+			return address;
+		}
+
+		/// Messages are small and answered at once, TCP must not hold them back
+		static void noDelay(const int fd) {
+			int on = 1;
+			setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+		}
+
+		static inline void queue(Link& link, const Message& message) {
+			link._out.append(reinterpret_cast<const char*>(&message), sizeof(message));
+		}
+
+		/**
+		 * @brief      { Waits until a link can be read, or written when it has bytes to send }
+		 */
+		static bool wait(const std::vector<Link>& links, std::vector<pollfd>& fds) {
+			fds.resize(links.size());
+			for (size_t link = 0; link < links.size(); link++) {
+				fds[link].fd = links[link]._fd;
+				fds[link].events = POLLIN;
+				if (!links[link]._out.empty())
+					fds[link].events |= POLLOUT;
+				fds[link].revents = 0;
+			}
+			while (poll(fds.data(), fds.size(), -1) < 0) {
+				if (errno != EINTR)
+					return false;
+			}
+			return true;
+		}
+
+		/**
+		 * @brief      { Sends and receives what link is ready for, without blocking }
+		 *
+		 * @param      link      The link
+		 * @param[in]  fd        Poll result of the link
+		 * @param      received  Complete messages received are appended here
+		 *
+		 * @return     { false when the other side has closed the link or on error }
+		 */
+		static bool exchange(Link& link, const pollfd& fd, std::vector<Message>& received) {
+			if ((fd.revents & POLLOUT) != 0) {
+				ssize_t count = ::send(link._fd, link._out.data(), link._out.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+				if (count < 0 && errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK)
+					return false;
+				if (count > 0)
+					link._out.erase(0, static_cast<size_t>(count));
+			}
+			if ((fd.revents & (POLLIN | POLLHUP | POLLERR)) == 0)
+				return true;
+
+			char buffer[64 * sizeof(Message)];
+			ssize_t count = ::recv(link._fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+			if (count < 0)
+				return errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK;
+			if (count == 0)
+				return false;
+			link._in.append(buffer, static_cast<size_t>(count));
+
+			size_t used = 0;
+			for (; link._in.size() - used >= sizeof(Message); used += sizeof(Message)) {
+				Message message;
+				std::memcpy(&message, link._in.data() + used, sizeof(message));
+				received.push_back(message);
+			}
+			link._in.erase(0, used);
+			return true;
+		}
+
+		static bool send(const int fd, const Message& message) {
+			const char* data = reinterpret_cast<const char*>(&message);
+			size_t left = sizeof(message);
+			while (left > 0) {
+				ssize_t count = ::send(fd, data, left, MSG_NOSIGNAL);
+				if (count < 0 && errno == EINTR)
+					continue;
+				if (count <= 0)
+					return false;
+				data += count;
+				left -= static_cast<size_t>(count);
+			}
+			return true;
+		}
+
+		static bool receive(const int fd, Message& message) {
+			char* data = reinterpret_cast<char*>(&message);
+			size_t left = sizeof(message);
+			while (left > 0) {
+				ssize_t count = ::recv(fd, data, left, 0);
+				if (count < 0 && errno == EINTR)
+					continue;
+				if (count <= 0)
+					return false;
+				data += count;
+				left -= static_cast<size_t>(count);
+			}
+			return true;
+		}
+
+	private:
+		int													_size;
+		int													_shards;
+		bool												_static;
+		std::vector<int>									_links;
+		std::vector<pid_t>									_pids;
+	};
+
+}
+
+#endif //SHARDED_RAYBOX_HPP
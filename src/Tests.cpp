@@ -1,10 +1,66 @@
-#include <gtest\gtest.h>
+#include <gtest/gtest.h>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
+#include "BinaryFormat.hpp"
+#include "ConfigFileReader.hpp"
+#include "EpochManager.hpp"
+#include "InterleavedTracer.hpp"
+#include "PacketTracer.hpp"
 #include "RayBox.hpp"
+#include "RelaxedTracer.hpp"
+#include "ResultWriter.hpp"
+#include "ShardedRaybox.hpp"
 using namespace RayBox;
 
+/// Board of engine tests: 8 x 8, with mirrors whose rays cross between bands 0 - 3 and 4 - 7
+static void addTestMirrors(Raybox& rayBox) {
+	rayBox.AddMirror(std::make_shared<Mirror>(1, 1));
+	rayBox.AddMirror(std::make_shared<Mirror>(4, 5));
+	rayBox.AddMirror(std::make_shared<Mirror>(6, 2));
+	rayBox.initReferences();
+}
+
+/// Rays entering at every border cell of the board
+static std::vector<Ray> borderRays(const int size) {
+	std::vector<Ray> rays;
+	for (int i = 0; i < size; i++) {
+		rays.push_back({ 0, i, Ray::Direction::LeftToRight });
+		rays.push_back({ size - 1, i, Ray::Direction::RightToLeft });
+		rays.push_back({ i, 0, Ray::Direction::TopToBottom });
+		rays.push_back({ i, size - 1, Ray::Direction::BottomToTop });
+	}
+	return rays;
+}
+
+/// Writes configuration file of a test, caller removes it
+static std::string writeConfig(const std::string& text) {
+	char path[] = "/tmp/RayBoxTestXXXXXX";
+	int fd = mkstemp(path);
+	if (fd >= 0)
+		close(fd);
+	std::ofstream(path) << text;
+	return path;
+}
+
+/// Results must be those of serial engine on a static board, ray by ray
+static void expectSerialResults(Raybox& rayBox, const std::vector<Ray>& rays, const std::vector<RayResult>& results) {
+	ASSERT_EQ(rays.size(), results.size());
+	for (size_t i = 0; i < rays.size(); i++) {
+		Ray ray = rays[i];
+		RayResult expected = rayBox.PassTheRay(ray);
+		EXPECT_EQ(expected._row, results[i]._row);
+		EXPECT_EQ(expected._column, results[i]._column);
+		EXPECT_EQ(expected._outcome, results[i]._outcome);
+		EXPECT_EQ(expected._hops, results[i]._hops);
+	}
+}
+
 TEST(RayBox_InvalidConfigInpu, RayBox)
 {
-	RayBox	rayBox(2);
+	Raybox	rayBox(2);
 
 	try {
 		std::shared_ptr<Mirror> mirror1 = std::make_shared<Mirror>(0, 0, 10);
@@ -16,4 +72,233 @@ TEST(RayBox_InvalidConfigInpu, RayBox)
 	catch(std::logic_error& ex) {
 		EXPECT_STREQ("Duplicate Mirror", ex.what());
 	}
-}
\ No newline at end of file
+}
+
+TEST(RayBox_LazyReferences, RayBox)
+{
+	Raybox eager(8);
+	Raybox lazy(8);
+	eager.AddMirror(std::make_shared<Mirror>(2, 1));
+	lazy.AddMirror(std::make_shared<Mirror>(2, 1));
+	eager.AddMirror(std::make_shared<Mirror>(7, 6, 2));
+	lazy.AddMirror(std::make_shared<Mirror>(7, 6, 2));
+	eager.initReferences();
+	lazy.initReferences(true);
+
+	for (int i = 0; i < 3; i++) {
+		Ray ray1 = { 0, 7, Ray::Direction::LeftToRight };
+		Ray ray2 = ray1;
+		RayResult expected = eager.PassTheRay(ray1);
+		RayResult result = lazy.PassTheRay(ray2);
+		EXPECT_EQ(expected._row, result._row);
+		EXPECT_EQ(expected._column, result._column);
+		EXPECT_EQ(expected._outcome, result._outcome);
+	}
+}
+
+TEST(RayBox_BinaryFormat, RayBox)
+{
+	RayInput input = { 'R', 5, '-' };
+	char rayRecord[BinaryFormat::RayRecordSize];
+	BinaryFormat::encodeRay(input, rayRecord);
+	RayInput decoded = BinaryFormat::decodeRay(rayRecord);
+	EXPECT_EQ('R', decoded._port);
+	EXPECT_EQ(5, decoded._index);
+	EXPECT_EQ('-', decoded._sign);
+
+	RayResult result = { 8, 7, RayResult::Outcome::Evaporated, 3 };
+	char resultRecord[BinaryFormat::ResultRecordSize];
+	BinaryFormat::encodeResult(result, resultRecord);
+	RayResult decodedResult = BinaryFormat::decodeResult(resultRecord);
+	EXPECT_EQ(8, decodedResult._row);
+	EXPECT_EQ(7, decodedResult._column);
+	EXPECT_EQ(RayResult::Outcome::Evaporated, decodedResult._outcome);
+	EXPECT_EQ(3, decodedResult._hops);
+}
+
+TEST(RayBox_InterleavedTracer, RayBox)
+{
+	Raybox rayBox(8);
+	addTestMirrors(rayBox);
+
+	BoardIndex index(rayBox);
+	EXPECT_TRUE(index.isStatic());
+
+	std::vector<Ray> rays = borderRays(8);
+	std::vector<RayResult> results;
+	InterleavedTracer(index, 4).trace(rays, results);
+	expectSerialResults(rayBox, rays, results);
+}
+
+TEST(RayBox_PacketTracer, RayBox)
+{
+	Raybox rayBox(8);
+	addTestMirrors(rayBox);
+
+	BoardIndex index(rayBox);
+	std::vector<Ray> rays = borderRays(8);
+	std::vector<RayResult> results;
+	std::vector<RayResult> scalarResults;
+	PacketTracer(index).trace(rays, results);
+	PacketTracer(index).traceScalar(rays, scalarResults);
+	expectSerialResults(rayBox, rays, results);
+	expectSerialResults(rayBox, rays, scalarResults);
+}
+
+TEST(RayBox_CycleDetection, RayBox)
+{
+	/// Rays between these mirrors are reversed back and forth forever
+	Raybox rayBox(8);
+	rayBox.AddMirror(std::make_shared<Mirror>(3, 1));
+	rayBox.AddMirror(std::make_shared<Mirror>(3, 3));
+	rayBox.initReferences();
+
+	Ray ray = { 2, 0, Ray::Direction::TopToBottom };
+	RayResult result = rayBox.PassTheRay(ray);
+	EXPECT_EQ(RayResult::Outcome::Unknown, result._outcome);
+
+	std::ostringstream out;
+	ResultWriter(out, ResultWriter::Format::Text).write("C3+", result);
+	EXPECT_EQ("C3+ -> {" + std::to_string(result._row) + "," + std::to_string(result._column) + "} unknown\n", out.str());
+	RayResult parsed;
+	EXPECT_TRUE(ConfigReader::parseResultLine(out.str(), parsed));
+	EXPECT_EQ(RayResult::Outcome::Unknown, parsed._outcome);
+
+	BoardIndex index(rayBox);
+	std::vector<Ray> rays = borderRays(8);
+	std::vector<RayResult> interleavedResults;
+	std::vector<RayResult> packetResults;
+	InterleavedTracer(index, 4).trace(rays, interleavedResults);
+	PacketTracer(index).trace(rays, packetResults);
+	expectSerialResults(rayBox, rays, interleavedResults);
+	expectSerialResults(rayBox, rays, packetResults);
+}
+
+TEST(RayBox_ShardedBands, RayBox)
+{
+	Raybox rayBox(8);
+	std::vector<std::shared_ptr<Raybox>> bands;
+	bands.push_back(std::make_shared<Raybox>(8, 0, 4));
+	bands.push_back(std::make_shared<Raybox>(8, 4, 8));
+	for (auto box : { &rayBox, bands[0].get(), bands[1].get() })
+		addTestMirrors(*box);
+
+	/// Handing every ray over between bands until it finishes
+	std::vector<Ray> rays = borderRays(8);
+	std::vector<RayResult> results;
+	for (Ray ray : rays) {
+		int band = bands[0]->inBand(ray._row) ? 0 : 1;
+		int hops = 0;
+		RayCycle cycle;
+		RayResult result = bands[band]->PassTheRay(ray, cycle);
+		for (; result._outcome == RayResult::Outcome::HandedOff; result = bands[band]->PassTheRay(ray, cycle)) {
+			hops += result._hops;
+			band = bands[band]->inBand(ray._row - 1) ? band + 1 : band - 1;
+		}
+		result._hops += hops;
+		results.push_back(result);
+	}
+	expectSerialResults(rayBox, rays, results);
+}
+
+TEST(RayBox_ShardedProcesses, RayBox)
+{
+	Raybox rayBox(8);
+	addTestMirrors(rayBox);
+	std::string config = writeConfig("8\n2 2\n5 6\n7 3\n");
+
+	std::vector<Ray> rays = borderRays(8);
+	std::vector<RayResult> results;
+	ShardedRaybox(config, 3, false).trace(rays, results);
+	expectSerialResults(rayBox, rays, results);
+	remove(config.c_str());
+
+	/// Rays cycling across bands stop where a single Raybox stops them
+	Raybox cycling(8);
+	cycling.AddMirror(std::make_shared<Mirror>(3, 1));
+	cycling.AddMirror(std::make_shared<Mirror>(3, 3));
+	cycling.initReferences();
+	config = writeConfig("8\n4 2\n4 4\n");
+
+	results.clear();
+	ShardedRaybox(config, 4, true).trace(rays, results);
+	expectSerialResults(cycling, rays, results);
+	remove(config.c_str());
+}
+
+TEST(RayBox_ShardedLoadFailure, RayBox)
+{
+	/// Second mirror lands on a reference mirror of the first one, in band of shard 1
+	std::string config = writeConfig("3\n1 2\n2 1\n");
+	EXPECT_THROW(ShardedRaybox(config, 3, false), std::logic_error);
+	remove(config.c_str());
+}
+
+TEST(RayBox_ConcurrentQuery, RayBox)
+{
+	Raybox rayBox(8);
+	rayBox.AddMirror(std::make_shared<Mirror>(1, 1));
+	rayBox.AddMirror(std::make_shared<Mirror>(6, 2, 1));
+	rayBox.initReferences();
+
+	/// Queries do not use up mirror strength
+	EpochManager::Reader reader(rayBox.getEpochs());
+	for (int i = 0; i < 2; i++) {
+		Ray ray = { 0, 6, Ray::Direction::LeftToRight };
+		EXPECT_EQ(RayResult::Outcome::Absorbed, rayBox.QueryTheRay(ray, reader)._outcome);
+	}
+
+	/// Query thread keeps tracing while mirror evaporates
+	std::thread query([&rayBox]() {
+		EpochManager::Reader reader(rayBox.getEpochs());
+		for (int i = 0; i < 1000; i++) {
+			Ray ray = { 0, 6, Ray::Direction::LeftToRight };
+			RayResult result = rayBox.QueryTheRay(ray, reader);
+			EXPECT_EQ(7, result._row);
+			EXPECT_TRUE(result._column == 3 || result._column == 8);
+		}
+	});
+	Ray ray = { 0, 6, Ray::Direction::LeftToRight };
+	EXPECT_EQ(RayResult::Outcome::Evaporated, rayBox.PassTheRay(ray)._outcome);
+	query.join();
+
+	ray = { 0, 6, Ray::Direction::LeftToRight };
+	EXPECT_EQ(8, rayBox.QueryTheRay(ray, reader)._column);
+
+	/// Mirror added after references are built is seen by queries
+	rayBox.AddMirror(std::make_shared<Mirror>(6, 5));
+	ray = { 0, 6, Ray::Direction::LeftToRight };
+	RayResult result = rayBox.QueryTheRay(ray, reader);
+	EXPECT_EQ(RayResult::Outcome::Absorbed, result._outcome);
+	EXPECT_EQ(6, result._column);
+}
+
+TEST(RayBox_RelaxedTracer, RayBox)
+{
+	Raybox rayBox(8);
+	rayBox.AddMirror(std::make_shared<Mirror>(1, 1));
+	rayBox.AddMirror(std::make_shared<Mirror>(6, 2, 3));
+	rayBox.initReferences();
+
+	std::vector<Ray> rays(100, { 0, 6, Ray::Direction::LeftToRight });
+	std::vector<RayResult> results;
+	RelaxedTracer(rayBox, 4).trace(rays, results);
+
+	/// Order is not known, but strength is used up exactly once
+	int absorbed = 0;
+	int evaporated = 0;
+	for (auto& result : results) {
+		absorbed += result._outcome == RayResult::Outcome::Absorbed ? 1 : 0;
+		evaporated += result._outcome == RayResult::Outcome::Evaporated ? 1 : 0;
+	}
+	EXPECT_EQ(2, absorbed);
+	EXPECT_EQ(1, evaporated);
+	EXPECT_EQ(nullptr, rayBox.getMirror(6, 2).get());
+
+	/// More threads than reader slots are capped, not failing inside a thread
+	RelaxedTracer(rayBox, 2 * EpochManager::MaxReaders).trace(rays, results);
+	Ray ray = rays[0];
+	RayResult expected = rayBox.PassTheRay(ray);
+	for (auto& result : results)
+		EXPECT_EQ(expected._outcome, result._outcome);
+}